@@ -0,0 +1,1893 @@
+//
+//  balancedtree.h
+//  RedBlackTree
+//
+//  One binary search tree core, parameterized by how it keeps itself
+//  balanced.  The core owns the descent, the links, the rotations, the
+//  subtree heights and every traversal, along with everything that doesn't
+//  care about balance: the finger for hinted inserts, the pointers to both
+//  ends, lazy deletes and Compact, the trace recorder and the Bloom filter.
+//  The policy only hears about inserts and deletes through a few hooks and
+//  decides which rotations to make.  See balancepolicies.h for the policies
+//  themselves and the aliases (AVLTree<T>, TreapTree<T>, ...); Tree<T> and
+//  RedBlackTree<T> are this core with a policy and their own names on top.
+//  The node is a parameter as well, BalancedTreeNode unless it says
+//  otherwise.  One whose KEEPS_HEIGHT is false has no stored heights to
+//  keep, and Height() walks the tree instead; Tree<T> uses that to keep its
+//  nodes small.
+//
+
+#ifndef BalancedTree_H
+#define BalancedTree_H
+
+#include "balancedtreenode.h"
+#include "treestats.h"
+#include "treetrace.h"
+#include "bloomfilter.h"
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <thread>
+using namespace std;
+
+// asks for the cache line at p ahead of time where the compiler can
+#if defined(__GNUC__)
+#define RBTREE_PREFETCH(p) __builtin_prefetch(p)
+#else
+#define RBTREE_PREFETCH(p) ((void)0)
+#endif
+
+// A policy derives from BalancePolicy, which has a do-nothing version of
+// each of these, and defines the ones it needs.  It is held by value in the
+// tree, so it can keep state (the treap keeps its random number generator):
+//
+//   static const char* Name();
+//   // gives a freshly allocated node its rank before it's linked in
+//   template <typename Tree> void Init(Tree& t, typename Tree::Node* n);
+//   // n has just been hung off the tree as a leaf, heights already fixed
+//   template <typename Tree> void After_Insert(Tree& t, typename Tree::Node* n);
+//   // kill is about to be unlinked, may rotate it down first
+//   template <typename Tree> void Before_Delete(Tree& t, typename Tree::Node* kill);
+//   // a node with rank removedRank was unlinked from the "left" side of parent
+//   // (parent is NULL if it was the root)
+//   template <typename Tree> void After_Delete(Tree& t, typename Tree::Node* parent,
+//                                               bool left, int removedRank);
+//   // an Access stopped at "last", the node holding x or, on a miss, the
+//   // last node it looked at (NULL only for an empty tree).  Find never
+//   // calls it
+//   template <typename Tree> void After_Access(Tree& t, typename Tree::Node* last);
+//   // Build_From_Sorted made n, "depth" below the root, with its children
+//   // and height already in place.  Every leaf is "levels" - 1 or
+//   // "levels" - 2 deep
+//   template <typename Tree> void After_Build(Tree& t, typename Tree::Node* n,
+//                                              int depth, int levels);
+//   // the tree was copied or rebuilt wholesale.  Both work lists below
+//   // start out empty, and a copy's nodes may need to go back on them
+//   template <typename Tree> void After_Rebuild(Tree& t);
+//   // whether a delete should only mark its node as a tombstone right now,
+//   // queued on "deferred" for the policy to unlink later
+//   bool Deferring() const;
+//   // the first thing wrong with the policy's ranks, NULL if nothing is
+//   template <typename Tree> const char* Verify(const Tree& t) const;
+//
+// A node with two children is never unlinked directly: its successor takes
+// its place and its rank, and the successor's old spot is the one reported.
+// Left_Rotate and Right_Rotate only relink and keep the heights; the ranks
+// of the two nodes involved are the policy's business.  A policy that puts
+// work off keeps it on the tree's "unfixed" list (nodes whose insert it
+// hasn't rebalanced yet) and "deferred" list (tombstones it hasn't unlinked),
+// since only the tree knows the node type; it unlinks with Unlink, after
+// taking the node off deadCount
+template <typename T, typename Policy, typename NodeType = BalancedTreeNode<T> >
+class BalancedTree{
+public:
+    typedef NodeType Node;
+
+    // default constructor, sets the root to NULL
+    BalancedTree();
+    // copy constructor, deep copies the other BalancedTree
+    BalancedTree(const BalancedTree& other);
+
+    // assignment, deep copies the other BalancedTree over this one
+    BalancedTree& operator=(const BalancedTree& other);
+
+    // destructor, destroys all nodes without recursing
+    ~BalancedTree();
+
+    // name of the balancing policy, for reports
+    static const char* Policy_Name();
+
+    // Insert item x into the correct position and let the policy rebalance
+    void Insert(const T& x);
+
+    // Same as Insert, but the search starts from where the last insert went
+    // (the finger) instead of the root: it climbs until it reaches a subtree
+    // x belongs in and only descends from there.  For keys arriving nearly in
+    // order that's O(1) amortized comparisons instead of O(log n)
+    void Insert_Hinted(const T& x);
+
+    // delets (a copy of) item x.  Returns true if it's found, False otherwise
+    bool Delete(const T& x);
+
+    // Determines whether item x is in the tree.  Returns true if found, false
+    // otherwise.  Never changes the tree, whatever the policy
+    bool Find(const T& x) const;
+
+    // Find, but lets a self-adjusting policy restructure the tree around the
+    // lookup, as the splay tree does.  The same as Find for the others
+    bool Access(const T& x);
+
+    // Looks up every key in "keys" and sets found[i] to whether keys[i] is in
+    // the tree.  The descents run side by side, a level at a time, and each
+    // prefetches the node it goes to next; by the time the batch comes back
+    // round to it the node is usually in cache, so one lookup's misses
+    // overlap the others' instead of each waiting its turn
+    void Find_Many(const vector<T>& keys, vector<bool>& found) const;
+
+    // Find with the comparisons left to "probe": probe(item) is < 0 if the
+    // key being looked for goes before item, 0 if it's equal and > 0 if it
+    // goes after.  It's called on the nodes from the root down, in order, so
+    // it can keep state between calls
+    template <typename Probe>
+    bool Find_By(Probe probe) const;
+
+    // number of items.  O(1)
+    long Size() const;
+
+    bool Is_Empty() const;
+
+    // sets x to the smallest item and returns true, or returns false if the
+    // tree is empty.  O(1): the tree keeps pointers to both ends, stepping
+    // past any tombstones there
+    bool Min(T& x) const;
+
+    // the same for the biggest item
+    bool Max(T& x) const;
+
+    // Min, and takes the item out.  No search: the end node has at most one
+    // child, so unlinking it is the cheap delete case.  While the policy is
+    // deferring deletes it's tombstoned like any delete
+    bool Pop_Min(T& x);
+
+    // the same for the biggest item
+    bool Pop_Max(T& x);
+
+    // returns the height of the longest branch, in nodes.  O(1): every node
+    // keeps the height of its subtree up to date
+    int Height() const;
+
+    // dumps all items in the tree into a sorted vector
+    void Dump_To_Vector(vector<T>& V) const;
+
+    // Dump_To_Vector on "threads" threads, 0 meaning one per core.  V grows
+    // once, by Size(); the top few levels of the tree are cut off, a counting
+    // pass over the subtrees hanging below them says where each one's items
+    // start, and the threads then copy whole subtrees into their own ranges,
+    // the biggest first, each taking whichever is next as it finishes one.
+    // Small trees aren't worth the threads and go on the calling one
+    void Dump_To_Vector_Parallel(vector<T>& V, int threads = 0) const;
+
+    // writes the items in order through "out" and returns it past the last
+    // one, for streaming into a buffer of Size() or more, or any other output
+    // iterator, with no vector in between
+    template <typename OutputIt>
+    OutputIt Dump_To(OutputIt out) const;
+
+    // Calls visit(item) for every item in sorted order
+    template <typename Visitor>
+    void Visit_In_Order(Visitor visit) const;
+
+    // prints all the values at a given depth
+    void Print_Nodes_At_Depth(int d) const;
+
+    // prints all the nodes by there depth
+    void Print_Nodes_By_Depth() const;
+
+    // Calls visit(item, depth) for every node in level order (root first, each
+    // level left to right) with the node's real depth, root being depth 1.
+    // One pass, and only two levels of the tree are queued at any time
+    template <typename Visitor>
+    void Visit_Level_Order(Visitor visit) const;
+
+    // fills counts so that counts[i] is the number of nodes at depth i + 1
+    void Depth_Histogram(vector<int>& counts) const;
+
+    string Path_To_Item(const T& x) const;
+
+    // Outputs the nodes of the tree in order (Left subtree, then the node, then
+    // the right subtree)
+    void Print_Inorder() const;
+
+    // outputs the actual tree, one node per line as item-rank
+    void Print_Treeorder() const;
+
+    // Outputs the nodes of the tree in NLR order
+    void Print_Preorder() const;
+
+    // Outputs the nodes of the tree in LRN order
+    void Print_Postorder() const;
+
+    // Lazy deletes: a delete only marks the node as a tombstone, with no
+    // rotations, and inserting the item again brings the node back.  Once
+    // the tombstones are more than "ratio" of the nodes the tree is rebuilt
+    // without them.  Turning it off compacts straight away.  While the
+    // policy is deferring deletes its deferral wins, and nothing gets revived
+    void Set_Lazy_Delete(bool on, double ratio = 0.25);
+
+    // rebuilds the tree from its live items, perfectly balanced, dropping
+    // every tombstone and anything the policy still had pending.  The new
+    // nodes sit in one block in van Emde Boas order, so a lookup touches a
+    // handful of cache lines instead of one per level, and a long churned
+    // tree gets its locality back.  Stop-the-world and O(n); every node
+    // moves, so nothing that pointed into the old tree stays good (the
+    // finger is dropped).  Slots deletes free up in the block are what later
+    // inserts get first
+    void Compact();
+
+    // replaces the contents with "items", which must be sorted, the same way
+    // Compact lays them out.  O(n), against O(n log n) for inserting them
+    void Build_From_Sorted(const vector<T>& items);
+
+    // Records every insert, delete and find from now on into "recorder", or
+    // stops recording if it's NULL.  The items already in the tree go in
+    // first, marked as preloads, so a replay starts from the same contents,
+    // and Build_From_Sorted and Compact record a reset and their items the
+    // same way.  Find_By has no key to record and isn't.  Returns false, and
+    // leaves recording as it was, if the recorder isn't open.  The recorder
+    // has to outlive the tree or be taken away first; copies of the tree
+    // don't record
+    bool Set_Recorder(TraceRecorder<T>* recorder);
+
+    // Puts a BlockedBloomFilter in front of Find and Find_Many, so a key
+    // that isn't there is usually turned away after one cache line instead
+    // of a walk to the bottom of the tree.  Inserts add to it.  Deletes can't
+    // take anything out, so it's rebuilt from the live items, O(n), once it
+    // holds more than twice as many as there are or more than it was sized
+    // for; either takes O(n) updates to happen again.  "bitsPerItem" trades
+    // memory for false positives, 10 giving about 1%.  Returns false, with
+    // no filter, if T has no std::hash.  Copies of the tree get their own
+    bool Set_Filter(bool on, int bitsPerItem = 10);
+
+    bool Has_Filter() const;
+
+    // checks everything the tree keeps true: links both ways, search order,
+    // the stored heights, the counts, the ends, the finger and the filter,
+    // then whatever the policy keeps true of its ranks.  Returns false, with
+    // the first thing found wrong on cerr, if any of it is off.  O(n) with
+    // no recursion, for tests and debugging
+    bool Verify() const;
+
+#ifdef RBTREE_STATS
+    // counters collected since construction or the last Reset_Stats
+    const TreeStats& Get_Stats() const;
+
+    void Reset_Stats();
+#endif
+
+protected:
+    friend Policy;
+
+    // what only some trees ever use, kept out of line so that a tree using
+    // none of it is its root, ends, finger, counts and policy and no more
+    struct Extras{
+        double compactRatio;
+        Node* arena;      // the block Compact put the nodes in, NULL if none
+        size_t arenaSize;
+        size_t arenaLive; // arena nodes not freed yet; the block goes with the last
+        Node* arenaFree;  // freed arena nodes, linked through their left pointers
+        TraceRecorder<T>* recorder; // NULL unless Set_Recorder gave it one
+        vector<Node*> unfixed;  // inserted nodes the policy still owes a fixup
+        vector<Node*> deferred; // tombstones the policy still has to unlink
+        BlockedBloomFilter<T>* filter; // NULL unless Set_Filter turned it on
+        int filterBits;                // bits per item it's sized with
+        long filterHeld;               // items added to it since it was last emptied
+
+        Extras();
+    };
+
+    Node* root;
+    Node* finger; // the node the last insert created, NULL if it's gone
+    Node* leftmost;  // the first node in order, tombstone or not
+    Node* rightmost; // the last
+    long nodeCount; // linked in nodes, tombstones included
+    long deadCount; // tombstones
+    Extras* extras; // NULL until something needs it, then kept
+    Policy balance;
+    bool lazyDeletes;
+#ifdef RBTREE_STATS
+    mutable TreeStats stats;
+#endif
+
+    // the Extras, made the first time they're asked for
+    Extras& More();
+
+    // these read the Extras without making them, NULL or the default if
+    // there are none
+    TraceRecorder<T>* Recorder() const;
+    BlockedBloomFilter<T>* Filter() const;
+    Node* Arena() const;
+    double Compact_Ratio() const;
+
+    // the policy's work lists.  Pending() is their total length
+    vector<Node*>& Unfixed();
+    vector<Node*>& Deferred();
+    size_t Pending() const;
+    bool Has_Unfixed() const;
+
+    // Delete without the recording or the Compact it may call for
+    bool Delete_Item(const T& x);
+
+    // takes "kill" out of the tree for good and frees it, letting the policy
+    // rebalance around the hole
+    void Unlink(Node* kill);
+
+    // marks "kill" deleted, and queues it if the policy is deferring
+    void Tombstone(Node* kill);
+
+    // the node before or after "node" in order, NULL at the ends
+    static Node* Prev_Node(Node* node);
+    static Node* Next_Node(Node* node);
+
+    // the last or first node in order that isn't a tombstone, NULL if none
+    Node* Live_End(bool last) const;
+
+    // does Pop_Min or Pop_Max
+    bool Pop_End(bool last, T& x);
+
+    // points leftmost and rightmost at the ends again, after the tree has
+    // been rebuilt or copied
+    void Find_Extremes();
+
+    // Hangs a new node holding x under the insert position found by searching
+    // down from "start", which must be a subtree x belongs in, then lets the
+    // policy rebalance
+    void Insert_Below(Node* start, const T& x);
+
+    // Climbs from the finger to the lowest ancestor whose subtree x belongs in.
+    // Returns the root when there's no finger
+    Node* Finger_Climb(const T& x) const;
+
+    // the filter's side of an insert, and whether it rules x out.  Both do
+    // nothing when there's no filter
+    void Filter_Add(const T& x);
+    bool Filter_Rejects(const T& x) const;
+
+    // empties the filter and sizes it for the tree as it is now
+    void Reset_Filter();
+
+    // Reset_Filter, and adds the live items back
+    void Rebuild_Filter();
+
+    // rebuilds the filter if it's gone stale or full
+    void Check_Filter();
+
+    // whether x is in the subtree at source, tombstones counting as there
+    bool Find_Helper(Node* source, const T& x) const;
+
+    // the node holding x, NULL if there's none.  "last" is left at the last
+    // node looked at.  Tombstones count as holding their items
+    Node* Find_Node(const T& x, Node*& last) const;
+
+    // finds a node holding x that is a tombstone or not, as asked.  NULL if
+    // there's none
+    Node* Find_Marked(const T& x, bool tombstone) const;
+
+    // the node a new x hangs under, searching down from "start".  NULL for
+    // an empty tree
+    Node* Find_Insert_Position(Node* start, const T& x) const;
+
+    // builds a balanced subtree out of items[low, high) under "parent",
+    // "depth" below the root of a tree whose leaves are all "levels" - 1 or
+    // "levels" - 2 deep.  The node for items[i] goes in arena[slots[i]]
+    Node* Build_Balanced(const vector<T>& items, size_t low, size_t high, Node* parent,
+                         int depth, int levels, const vector<size_t>& slots);
+
+    // writes "items", the tree's whole new contents, to the recorder as
+    // preloads, after a reset record if the old contents are being replaced
+    void Record_Contents(const vector<T>& items, bool reset);
+
+    // appends to "order" the middles of the ranges Build_Balanced will make
+    // out of [low, high), "levels" deep, in van Emde Boas order
+    static void Layout_Order(size_t low, size_t high, int levels, vector<size_t>& order);
+
+    // appends the ranges "depth" levels below [low, high), left to right
+    static void Ranges_At_Depth(size_t low, size_t high, int depth, vector<pair<size_t, size_t> >& ranges);
+
+    // a fresh node, a freed arena slot if there is one
+    Node* New_Node();
+
+    // deletes a node, or gives it back to the arena if it lives there
+    void Free_Node(Node* node);
+
+    // rotations the policies build their fixups from.  They keep the two
+    // nodes' heights right, and the ones above them too unless "upward" is
+    // false, for a caller that's going to rotate its way to the root anyway
+    void Left_Rotate(Node* source, bool upward = true);
+    void Right_Rotate(Node* source, bool upward = true);
+
+    // puts "replacement" (may be NULL) where "old" hangs from its parent
+    void Transplant(Node* old, Node* replacement);
+
+    // height of the subtree at source, 0 for an empty one.  Only for a node
+    // type that keeps heights
+    static int Height_Of(Node* source);
+
+    // recomputes source's height from its children.  This and the two below
+    // do nothing for a node type that keeps no heights
+    static void Update_Height(Node* source);
+
+    // recomputes heights from source up towards the root, stopping as soon as
+    // one doesn't change
+    static void Update_Heights_Upward(Node* source);
+
+    // after a rotation has put "up" where "down" was, with "down" now its
+    // child: their heights, and above them if "upward"
+    static void Fix_Rotated_Heights(Node* down, Node* up, bool upward);
+
+    // Creates a new set of nodes that is a deep copy of the tree at source,
+    // ranks, heights and tombstones included
+    Node* Copy_Tree(Node* source);
+
+    // deletes every node in the tree at source
+    void Delete_Tree(Node* source);
+
+    // takes the subtree at "source" apart a leaf at a time, handing each node
+    // to free(node) once nothing points to it
+    template <typename Free>
+    static void Free_Subtree(Node* source, Free free);
+
+    // the orders Walk can hand nodes to its visitor in
+    enum WalkOrder { PREORDER, INORDER, POSTORDER };
+
+    // Visits every node in the subtree at "source" by following parent
+    // pointers, so it needs no recursion and no stack.  Calls
+    // visit(node, depth) in the given order, depth 0 being source
+    template <typename Visitor>
+    void Walk(Node* source, WalkOrder order, Visitor visit) const;
+
+    // prints all the nodes d levels below source
+    void Print_Depth_Helper(Node* source, int d) const;
+
+    // Dump_To for the subtree at "source"
+    template <typename OutputIt>
+    OutputIt Dump_Helper(Node* source, OutputIt out) const;
+
+    // appends, in order, the nodes less than "levels" below source one at a
+    // time (whole = false) and the subtrees hanging "levels" below it whole
+    void Cut_Pieces(Node* source, int levels, vector<pair<Node*, bool> >& pieces) const;
+
+    // runs work(i) for every i < count on "threads" threads, which take the
+    // next i as they finish one
+    template <typename Work>
+    static void Run_Pieces(int threads, size_t count, Work work);
+};
+
+
+// default constructor, sets the root to NULL.
+// Note that "root == NULL" is what an empty tree looks like, so everything
+// that takes nodes out has to keep it that way
+template <typename T, typename Policy, typename NodeType>
+BalancedTree<T, Policy, NodeType>::BalancedTree(){
+    root = NULL;
+    finger = NULL;
+    lazyDeletes = false;
+    nodeCount = 0;
+    deadCount = 0;
+    extras = NULL;
+    leftmost = NULL;
+    rightmost = NULL;
+}
+
+template <typename T, typename Policy, typename NodeType>
+BalancedTree<T, Policy, NodeType>::Extras::Extras(){
+    compactRatio = 0.25;
+    arena = NULL;
+    arenaSize = 0;
+    arenaLive = 0;
+    arenaFree = NULL;
+    recorder = NULL;
+    filter = NULL;
+    filterBits = 10;
+    filterHeld = 0;
+}
+
+// copy constructor: the copy's nodes are allocated one by one, and it
+// doesn't record
+template <typename T, typename Policy, typename NodeType>
+BalancedTree<T, Policy, NodeType>::BalancedTree(const BalancedTree& other) : balance(other.balance){
+    extras = NULL;
+    root = Copy_Tree(other.root);
+    finger = NULL;
+    lazyDeletes = other.lazyDeletes;
+    nodeCount = other.nodeCount;
+    deadCount = other.deadCount;
+    if(other.extras != NULL){
+        More().compactRatio = other.extras->compactRatio;
+        extras->filterBits = other.extras->filterBits;
+    }
+    Find_Extremes();
+    balance.After_Rebuild(*this);
+    if(other.Filter() != NULL){
+        extras->filter = new BlockedBloomFilter<T>;
+        Rebuild_Filter();
+    }
+}
+
+// assignment: copy first so a throwing copy leaves us untouched
+template <typename T, typename Policy, typename NodeType>
+BalancedTree<T, Policy, NodeType>& BalancedTree<T, Policy, NodeType>::operator=(const BalancedTree& other){
+    if(this != &other){
+        Node* copy = Copy_Tree(other.root);
+        Delete_Tree(root);
+        root = copy;
+        finger = NULL;
+        balance = other.balance;
+        lazyDeletes = other.lazyDeletes;
+        nodeCount = other.nodeCount;
+        deadCount = other.deadCount;
+        if(extras != NULL){
+            extras->unfixed.clear();
+            extras->deferred.clear();
+            delete extras->filter;
+            extras->filter = NULL;
+            extras->filterHeld = 0;
+        }
+        if(other.extras != NULL){
+            More().compactRatio = other.extras->compactRatio;
+            extras->filterBits = other.extras->filterBits;
+        }
+        else if(extras != NULL){
+            extras->compactRatio = Extras().compactRatio;
+            extras->filterBits = Extras().filterBits;
+        }
+        Find_Extremes();
+        balance.After_Rebuild(*this);
+        if(other.Filter() != NULL){
+            extras->filter = new BlockedBloomFilter<T>;
+            Rebuild_Filter();
+        }
+    }
+    return *this;
+}
+
+template <typename T, typename Policy, typename NodeType>
+BalancedTree<T, Policy, NodeType>::~BalancedTree(){
+    Delete_Tree(root);
+    root = NULL;
+    if(extras != NULL)
+        delete extras->filter;
+    delete extras;
+}
+
+template <typename T, typename Policy, typename NodeType>
+const char* BalancedTree<T, Policy, NodeType>::Policy_Name(){
+    return Policy::Name();
+}
+
+template <typename T, typename Policy, typename NodeType>
+void BalancedTree<T, Policy, NodeType>::Insert(const T& x){
+    RBTREE_TIME(stats.insertLatency);
+    RBTREE_STAT(stats.Begin_Lookup());
+    if(Recorder() != NULL)
+        Recorder()->Record(TRACE_INSERT, x, TRACE_HIT);
+    Insert_Below(root, x);
+}
+
+template <typename T, typename Policy, typename NodeType>
+void BalancedTree<T, Policy, NodeType>::Insert_Hinted(const T& x){
+    RBTREE_TIME(stats.insertLatency);
+    RBTREE_STAT(stats.Begin_Lookup());
+    if(Recorder() != NULL)
+        Recorder()->Record(TRACE_INSERT, x, TRACE_HIT);
+    Insert_Below(Finger_Climb(x), x);
+}
+
+// Finger_Climb: say x is bigger than the finger.  A subtree's upper bound is
+// the first ancestor above it that it hangs off the left of, so stepping up
+// from a right child keeps the bound and stepping up from a left child
+// reveals it.  If that bound is still < x the subtree below can't hold x and
+// the parent becomes the candidate; the first bound that's >= x means the
+// candidate's subtree is where x goes.  Smaller x is the mirror image
+template <typename T, typename Policy, typename NodeType>
+typename BalancedTree<T, Policy, NodeType>::Node*
+BalancedTree<T, Policy, NodeType>::Finger_Climb(const T& x) const{
+    if(finger == NULL)
+        return root;
+    Node* cur = finger;
+    Node* candidate = finger;
+    RBTREE_STAT(stats.comparisons++);
+    bool goingRight = !(finger->get_item() >= x);
+    while(cur->get_parent() != NULL){
+        Node* parent = cur->get_parent();
+        bool fromLeft = parent->get_left() == cur;
+        if(goingRight == fromLeft){ // the parent bounds everything below it
+            RBTREE_STAT(stats.Hop());
+            RBTREE_STAT(stats.comparisons++);
+            if(goingRight == (parent->get_item() >= x))
+                return candidate;
+            candidate = parent;
+        }
+        cur = parent;
+    }
+    return candidate; // unbounded on that side
+}
+
+// Insert_Below: does the actual work of both inserts
+template <typename T, typename Policy, typename NodeType>
+void BalancedTree<T, Policy, NodeType>::Insert_Below(Node* start, const T& x){
+    if(Filter() != NULL){ // a rebuild first, or it would miss x
+        Check_Filter();
+        Filter_Add(x);
+    }
+    if(deadCount > 0 && lazyDeletes && !balance.Deferring()){ // a tombstone for x comes back to life
+        Node* dead = Find_Marked(x, true);
+        if(dead != NULL){
+            dead->set_tombstone(false);
+            deadCount--;
+            finger = dead;
+            return;
+        }
+    }
+    RBTREE_STAT(stats.allocations++);
+    nodeCount++;
+    Node* parent = Find_Insert_Position(start, x);
+    Node* new_guy = New_Node();
+    new_guy->set_item(x);
+    new_guy->set_parent(parent);
+    balance.Init(*this, new_guy);
+    if(parent == NULL){ // the new root
+        root = new_guy;
+        leftmost = new_guy;
+        rightmost = new_guy;
+    }
+    else{
+        if(parent->get_item() >= x) // x goes on the left
+            parent->set_left(new_guy);
+        else
+            parent->set_right(new_guy);
+        if(parent == leftmost && parent->get_left() == new_guy)
+            leftmost = new_guy;
+        if(parent == rightmost && parent->get_right() == new_guy)
+            rightmost = new_guy;
+        Update_Heights_Upward(parent);
+    }
+    finger = new_guy;
+    balance.After_Insert(*this, new_guy);
+}
+
+template <typename T, typename Policy, typename NodeType>
+bool BalancedTree<T, Policy, NodeType>::Delete(const T& x){
+    RBTREE_TIME(stats.deleteLatency);
+    bool deleted = Delete_Item(x);
+    if(Recorder() != NULL)
+        Recorder()->Record(TRACE_DELETE, x, deleted ? TRACE_HIT : 0);
+    // only now, so the contents a Compact records come after the delete
+    if(deleted && lazyDeletes && !balance.Deferring() && deadCount > Compact_Ratio() * nodeCount)
+        Compact();
+    if(deleted && Filter() != NULL)
+        Check_Filter();
+    return deleted;
+}
+
+template <typename T, typename Policy, typename NodeType>
+typename BalancedTree<T, Policy, NodeType>::Extras& BalancedTree<T, Policy, NodeType>::More(){
+    if(extras == NULL)
+        extras = new Extras;
+    return *extras;
+}
+
+template <typename T, typename Policy, typename NodeType>
+TraceRecorder<T>* BalancedTree<T, Policy, NodeType>::Recorder() const{
+    return extras == NULL ? NULL : extras->recorder;
+}
+
+template <typename T, typename Policy, typename NodeType>
+BlockedBloomFilter<T>* BalancedTree<T, Policy, NodeType>::Filter() const{
+    return extras == NULL ? NULL : extras->filter;
+}
+
+template <typename T, typename Policy, typename NodeType>
+typename BalancedTree<T, Policy, NodeType>::Node* BalancedTree<T, Policy, NodeType>::Arena() const{
+    return extras == NULL ? NULL : extras->arena;
+}
+
+template <typename T, typename Policy, typename NodeType>
+double BalancedTree<T, Policy, NodeType>::Compact_Ratio() const{
+    return extras == NULL ? Extras().compactRatio : extras->compactRatio;
+}
+
+template <typename T, typename Policy, typename NodeType>
+vector<typename BalancedTree<T, Policy, NodeType>::Node*>& BalancedTree<T, Policy, NodeType>::Unfixed(){
+    return More().unfixed;
+}
+
+template <typename T, typename Policy, typename NodeType>
+vector<typename BalancedTree<T, Policy, NodeType>::Node*>& BalancedTree<T, Policy, NodeType>::Deferred(){
+    return More().deferred;
+}
+
+template <typename T, typename Policy, typename NodeType>
+size_t BalancedTree<T, Policy, NodeType>::Pending() const{
+    return extras == NULL ? 0 : extras->unfixed.size() + extras->deferred.size();
+}
+
+template <typename T, typename Policy, typename NodeType>
+bool BalancedTree<T, Policy, NodeType>::Has_Unfixed() const{
+    return extras != NULL && !extras->unfixed.empty();
+}
+
+template <typename T, typename Policy, typename NodeType>
+bool BalancedTree<T, Policy, NodeType>::Delete_Item(const T& x){
+    if(root == NULL)
+        return false;
+    RBTREE_STAT(stats.Begin_Lookup());
+    Node* last;
+    Node* kill = deadCount == 0 ? Find_Node(x, last) : Find_Marked(x, false);
+    if(kill == NULL)
+        return false;
+    if(balance.Deferring() || lazyDeletes)
+        Tombstone(kill);
+    else
+        Unlink(kill);
+    return true;
+}
+
+// Tombstone: while the policy defers, unlinking is its job
+template <typename T, typename Policy, typename NodeType>
+void BalancedTree<T, Policy, NodeType>::Tombstone(Node* kill){
+    kill->set_tombstone(true);
+    deadCount++;
+    if(balance.Deferring())
+        Deferred().push_back(kill);
+}
+
+// Unlink: a node with two children swaps places with its successor first, so
+// the node actually unlinked never has more than one child.  Everything from
+// the hole up may have changed height.  The successor case moved a node onto
+// that path too, so it can't stop early; the others, which every Pop_Min and
+// Pop_Max is, can
+template <typename T, typename Policy, typename NodeType>
+void BalancedTree<T, Policy, NodeType>::Unlink(Node* kill){
+    balance.Before_Delete(*this, kill);
+    if(kill == leftmost)
+        leftmost = Next_Node(kill);
+    if(kill == rightmost)
+        rightmost = Prev_Node(kill);
+
+    Node* parent;
+    bool left;
+    int removedRank;
+    if(kill->get_left() != NULL && kill->get_right() != NULL){
+        Node* successor = kill->get_right();
+        while(successor->get_left() != NULL)
+            successor = successor->get_left();
+        removedRank = successor->get_rank();
+        if(successor->get_parent() == kill){ // its spot becomes its own right
+            parent = successor;
+            left = false;
+        }
+        else{
+            parent = successor->get_parent();
+            left = true;
+            Transplant(successor, successor->get_right());
+            successor->set_right(kill->get_right());
+            successor->get_right()->set_parent(successor);
+        }
+        Transplant(kill, successor);
+        successor->set_left(kill->get_left());
+        successor->get_left()->set_parent(successor);
+        successor->set_rank(kill->get_rank());
+        for(Node* p = parent; p != NULL; p = p->get_parent())
+            Update_Height(p);
+    }
+    else{
+        parent = kill->get_parent();
+        left = parent != NULL && parent->get_left() == kill;
+        removedRank = kill->get_rank();
+        Transplant(kill, kill->get_left() != NULL ? kill->get_left() : kill->get_right());
+        Update_Heights_Upward(parent);
+    }
+    if(kill == finger)
+        finger = NULL;
+    kill->set_left(NULL);
+    kill->set_right(NULL);
+    Free_Node(kill);
+    nodeCount--;
+    RBTREE_STAT(stats.frees++);
+    balance.After_Delete(*this, parent, left, removedRank);
+}
+
+template <typename T, typename Policy, typename NodeType>
+bool BalancedTree<T, Policy, NodeType>::Find(const T& x) const{
+    RBTREE_TIME(stats.findLatency);
+    RBTREE_STAT(stats.Begin_Lookup());
+    bool found = !Filter_Rejects(x) && (deadCount > 0 ? Find_Marked(x, false) != NULL : Find_Helper(root, x));
+    if(Recorder() != NULL)
+        Recorder()->Record(TRACE_FIND, x, found ? TRACE_HIT : 0);
+    return found;
+}
+
+template <typename T, typename Policy, typename NodeType>
+bool BalancedTree<T, Policy, NodeType>::Access(const T& x){
+    RBTREE_TIME(stats.findLatency);
+    RBTREE_STAT(stats.Begin_Lookup());
+    Node* last = NULL;
+    bool found = !Filter_Rejects(x) && Find_Node(x, last) != NULL;
+    if(found && deadCount > 0)
+        found = Find_Marked(x, false) != NULL;
+    if(Recorder() != NULL)
+        Recorder()->Record(TRACE_FIND, x, found ? TRACE_HIT : 0);
+    balance.After_Access(*this, last);
+    return found;
+}
+
+// Find_Many: a group much bigger than the number of misses the core can
+// have in flight buys nothing, and a much smaller one leaves the prefetches
+// too little time.  Tombstones need the slower run walk, so they fall back
+// to one Find at a time
+template <typename T, typename Policy, typename NodeType>
+void BalancedTree<T, Policy, NodeType>::Find_Many(const vector<T>& keys, vector<bool>& found) const{
+    const size_t GROUP = 16;
+    found.assign(keys.size(), false);
+    if(deadCount > 0){
+        for(size_t i = 0; i < keys.size(); i++)
+            found[i] = Find(keys[i]);
+        return;
+    }
+    Node* cur[GROUP];
+    for(size_t start = 0; start < keys.size(); start += GROUP){
+        size_t count = keys.size() - start < GROUP ? keys.size() - start : GROUP;
+        bool busy = false;
+        for(size_t i = 0; i < count; i++){
+            cur[i] = Filter_Rejects(keys[start + i]) ? NULL : root;
+            busy = busy || cur[i] != NULL;
+        }
+        RBTREE_STAT(stats.lookups += count);
+        while(busy){
+            busy = false;
+            for(size_t i = 0; i < count; i++){
+                if(cur[i] == NULL)
+                    continue;
+                RBTREE_STAT(stats.hops++);
+                RBTREE_STAT(stats.comparisons += 2);
+                const T& x = keys[start + i];
+                if(cur[i]->get_item() == x){
+                    found[start + i] = true;
+                    cur[i] = NULL;
+                    continue;
+                }
+                cur[i] = cur[i]->get_item() < x ? cur[i]->get_right() : cur[i]->get_left();
+                if(cur[i] != NULL){
+                    RBTREE_PREFETCH(cur[i]);
+                    busy = true;
+                }
+            }
+        }
+    }
+    for(size_t i = 0; Recorder() != NULL && i < keys.size(); i++)
+        Recorder()->Record(TRACE_FIND, keys[i], found[i] ? TRACE_HIT : 0);
+}
+
+// Find_By: a tombstone that matches still has an item equal to the key, so
+// it can stand in for the key in the run walk
+template <typename T, typename Policy, typename NodeType>
+template <typename Probe>
+bool BalancedTree<T, Policy, NodeType>::Find_By(Probe probe) const{
+    RBTREE_TIME(stats.findLatency);
+    RBTREE_STAT(stats.Begin_Lookup());
+    Node* cur = root;
+    while(cur != NULL){
+        RBTREE_STAT(stats.Hop());
+        RBTREE_STAT(stats.comparisons++);
+        int c = probe(cur->get_item());
+        if(c == 0)
+            return !cur->is_tombstone() || Find_Marked(cur->get_item(), false) != NULL;
+        cur = c < 0 ? cur->get_left() : cur->get_right();
+    }
+    return false;
+}
+
+template <typename T, typename Policy, typename NodeType>
+long BalancedTree<T, Policy, NodeType>::Size() const{
+    return nodeCount - deadCount;
+}
+
+template <typename T, typename Policy, typename NodeType>
+bool BalancedTree<T, Policy, NodeType>::Is_Empty() const{
+    return nodeCount == deadCount;
+}
+
+template <typename T, typename Policy, typename NodeType>
+bool BalancedTree<T, Policy, NodeType>::Min(T& x) const{
+    Node* node = Live_End(false);
+    if(node == NULL)
+        return false;
+    x = node->get_item();
+    return true;
+}
+
+template <typename T, typename Policy, typename NodeType>
+bool BalancedTree<T, Policy, NodeType>::Max(T& x) const{
+    Node* node = Live_End(true);
+    if(node == NULL)
+        return false;
+    x = node->get_item();
+    return true;
+}
+
+template <typename T, typename Policy, typename NodeType>
+bool BalancedTree<T, Policy, NodeType>::Pop_Min(T& x){
+    RBTREE_TIME(stats.deleteLatency);
+    return Pop_End(false, x);
+}
+
+template <typename T, typename Policy, typename NodeType>
+bool BalancedTree<T, Policy, NodeType>::Pop_Max(T& x){
+    RBTREE_TIME(stats.deleteLatency);
+    return Pop_End(true, x);
+}
+
+// Live_End: a run of tombstones at an end is only as long as lazy deletes
+// let it get before a Compact, or the policy before it catches up
+template <typename T, typename Policy, typename NodeType>
+typename BalancedTree<T, Policy, NodeType>::Node*
+BalancedTree<T, Policy, NodeType>::Live_End(bool last) const{
+    Node* node = last ? rightmost : leftmost;
+    while(node != NULL && node->is_tombstone())
+        node = last ? Prev_Node(node) : Next_Node(node);
+    return node;
+}
+
+// Pop_End: lazy deletes would only leave a growing run of tombstones for
+// the next pop to step over, so unless the policy is deferring deletes the
+// node is unlinked for real
+template <typename T, typename Policy, typename NodeType>
+bool BalancedTree<T, Policy, NodeType>::Pop_End(bool last, T& x){
+    Node* node = Live_End(last);
+    if(node == NULL)
+        return false;
+    x = node->get_item();
+    if(balance.Deferring())
+        Tombstone(node);
+    else
+        Unlink(node);
+    if(Recorder() != NULL)
+        Recorder()->Record(TRACE_DELETE, x, TRACE_HIT);
+    if(Filter() != NULL)
+        Check_Filter();
+    return true;
+}
+
+template <typename T, typename Policy, typename NodeType>
+int BalancedTree<T, Policy, NodeType>::Height() const{
+    if constexpr(Node::KEEPS_HEIGHT)
+        return Height_Of(root);
+    else{ // nothing stored, so it's one more than the deepest node's depth
+        int height = 0;
+        Walk(root, PREORDER, [&height](Node*, int depth){
+            if(depth + 1 > height)
+                height = depth + 1;
+        });
+        return height;
+    }
+}
+
+// Dump_To_Vector: sized up front and written in place, which is about twice
+// as fast as growing it a push_back at a time, even reserved
+template <typename T, typename Policy, typename NodeType>
+void BalancedTree<T, Policy, NodeType>::Dump_To_Vector(vector<T>& v) const{
+    size_t base = v.size();
+    v.resize(base + Size());
+    Dump_Helper(root, v.begin() + base);
+}
+
+// Dump_To_Vector_Parallel: the pieces are the cut off nodes, one at a time,
+// and the subtrees below them.  There are eight or more subtrees a thread,
+// which evens out lopsided siblings
+template <typename T, typename Policy, typename NodeType>
+void BalancedTree<T, Policy, NodeType>::Dump_To_Vector_Parallel(vector<T>& v, int threads) const{
+    const long PARALLEL_MIN = 1 << 16; // fewer items than this go on one thread
+    if(threads <= 0)
+        threads = (int)thread::hardware_concurrency();
+    size_t base = v.size();
+    v.resize(base + Size());
+    if(threads <= 1 || Size() < PARALLEL_MIN){
+        Dump_Helper(root, v.begin() + base);
+        return;
+    }
+    int levels = 0;
+    while((1L << levels) < 8L * threads && levels < 20)
+        levels++;
+    vector<pair<Node*, bool> > pieces;
+    Cut_Pieces(root, levels, pieces);
+    vector<size_t> at(pieces.size() + 1, 0);
+    Run_Pieces(threads, pieces.size(), [&](size_t i){
+        long count = 0;
+        if(pieces[i].second)
+            Walk(pieces[i].first, INORDER, [&count](Node* node, int){
+                count += !node->is_tombstone();
+            });
+        else
+            count = !pieces[i].first->is_tombstone();
+        at[i + 1] = count;
+    });
+    vector<size_t> order;
+    for(size_t i = 0; i < pieces.size(); i++){
+        order.push_back(i);
+        at[i + 1] += at[i];
+    }
+    sort(order.begin(), order.end(), [&at](size_t a, size_t b){
+        return at[a + 1] - at[a] > at[b + 1] - at[b];
+    });
+    Run_Pieces(threads, order.size(), [&](size_t i){
+        size_t piece = order[i];
+        typename vector<T>::iterator out = v.begin() + base + at[piece];
+        if(pieces[piece].second)
+            Dump_Helper(pieces[piece].first, out);
+        else if(!pieces[piece].first->is_tombstone())
+            *out = pieces[piece].first->get_item();
+    });
+}
+
+template <typename T, typename Policy, typename NodeType>
+template <typename OutputIt>
+OutputIt BalancedTree<T, Policy, NodeType>::Dump_To(OutputIt out) const{
+    return Dump_Helper(root, out);
+}
+
+template <typename T, typename Policy, typename NodeType>
+template <typename Visitor>
+void BalancedTree<T, Policy, NodeType>::Visit_In_Order(Visitor visit) const{
+    Walk(root, INORDER, [&visit](Node* node, int){
+        if(!node->is_tombstone())
+            visit(node->get_item());
+    });
+}
+
+template <typename T, typename Policy, typename NodeType>
+void BalancedTree<T, Policy, NodeType>::Print_Nodes_At_Depth(int d) const{
+    Print_Depth_Helper(root, d - 1);
+}
+
+template <typename T, typename Policy, typename NodeType>
+void BalancedTree<T, Policy, NodeType>::Print_Nodes_By_Depth() const{
+    int current = 0;
+    Visit_Level_Order([&current](const T& item, int depth){
+        if(depth != current){ // starting a new level
+            if(current != 0)
+                cout << endl;
+            cout << "At depth " << depth << ": ";
+            current = depth;
+        }
+        cout << item << " ";
+    });
+    if(current != 0)
+        cout << endl;
+}
+
+// Visit_Level_Order: breadth first walk that keeps the current level and the
+// one below it, so the depth comes from the walk itself
+template <typename T, typename Policy, typename NodeType>
+template <typename Visitor>
+void BalancedTree<T, Policy, NodeType>::Visit_Level_Order(Visitor visit) const{
+    vector<Node*> cur;
+    vector<Node*> next;
+    if(root != NULL)
+        cur.push_back(root);
+    int depth = 1;
+    while(!cur.empty()){
+        for(size_t i = 0; i < cur.size(); i++){
+            if(!cur[i]->is_tombstone())
+                visit(cur[i]->get_item(), depth);
+            if(cur[i]->get_left() != NULL)
+                next.push_back(cur[i]->get_left());
+            if(cur[i]->get_right() != NULL)
+                next.push_back(cur[i]->get_right());
+        }
+        cur.swap(next);
+        next.clear();
+        depth++;
+    }
+}
+
+template <typename T, typename Policy, typename NodeType>
+void BalancedTree<T, Policy, NodeType>::Depth_Histogram(vector<int>& counts) const{
+    counts.clear();
+    Visit_Level_Order([&counts](const T&, int depth){
+        if((int)counts.size() < depth)
+            counts.push_back(0);
+        counts[depth - 1]++;
+    });
+}
+
+template <typename T, typename Policy, typename NodeType>
+string BalancedTree<T, Policy, NodeType>::Path_To_Item(const T& x) const{
+    string path;
+    Node* cur = root;
+    while(cur != NULL && !(cur->get_item() == x)){
+        if(cur->get_item() < x){
+            path = path + "R, ";
+            cur = cur->get_right();
+        }
+        else{
+            path = path + "L, ";
+            cur = cur->get_left();
+        }
+    }
+    return path;
+}
+
+template <typename T, typename Policy, typename NodeType>
+void BalancedTree<T, Policy, NodeType>::Print_Inorder() const{
+    Walk(root, INORDER, [](Node* node, int){
+        if(!node->is_tombstone())
+            cout << node->get_item() << " ";
+    });
+}
+
+template <typename T, typename Policy, typename NodeType>
+void BalancedTree<T, Policy, NodeType>::Print_Treeorder() const{
+    Walk(root, PREORDER, [](Node* node, int depth){
+        for(int i = 0; i <= depth; i++)
+            cout << " ";
+        cout << node->get_item() << "-" << node->get_rank() << endl;
+    });
+    cout << endl;
+}
+
+template <typename T, typename Policy, typename NodeType>
+void BalancedTree<T, Policy, NodeType>::Print_Preorder() const{
+    Walk(root, PREORDER, [](Node* node, int){
+        if(!node->is_tombstone())
+            cout << node->get_item() << " ";
+    });
+    cout << endl;
+}
+
+template <typename T, typename Policy, typename NodeType>
+void BalancedTree<T, Policy, NodeType>::Print_Postorder() const{
+    Walk(root, POSTORDER, [](Node* node, int){
+        if(!node->is_tombstone())
+            cout << node->get_item() << " ";
+    });
+}
+
+template <typename T, typename Policy, typename NodeType>
+void BalancedTree<T, Policy, NodeType>::Set_Lazy_Delete(bool on, double ratio){
+    lazyDeletes = on;
+    if(extras != NULL || ratio != Compact_Ratio())
+        More().compactRatio = ratio;
+    if(!on && deadCount > 0 && !balance.Deferring())
+        Compact();
+}
+
+template <typename T, typename Policy, typename NodeType>
+void BalancedTree<T, Policy, NodeType>::Compact(){
+    vector<T> items;
+    Dump_To_Vector(items);
+    Build_From_Sorted(items);
+}
+
+// Build_From_Sorted: the middle item is the root and each half its subtrees,
+// so every leaf ends up on one of the two deepest levels and the policy can
+// rank the nodes from their depth alone.  The old arena, if any, is gone by
+// the time the new one is allocated
+template <typename T, typename Policy, typename NodeType>
+void BalancedTree<T, Policy, NodeType>::Build_From_Sorted(const vector<T>& items){
+    Record_Contents(items, true);
+    Delete_Tree(root);
+    if(extras != NULL){
+        extras->unfixed.clear();
+        extras->deferred.clear();
+    }
+    finger = NULL;
+    nodeCount = (long)items.size();
+    deadCount = 0;
+    if(Filter() != NULL){ // nothing from before stays, and the new items go straight in
+        Reset_Filter();
+        for(size_t i = 0; i < items.size(); i++)
+            Filter_Add(items[i]);
+    }
+    int levels = 0; // of a perfect tree holding at least that many
+    while(((size_t)1 << levels) - 1 < items.size())
+        levels++;
+    root = NULL;
+    leftmost = NULL;
+    rightmost = NULL;
+    if(!items.empty()){
+        vector<size_t> order;
+        order.reserve(items.size());
+        Layout_Order(0, items.size(), levels, order);
+        vector<size_t> slots(items.size());
+        for(size_t i = 0; i < order.size(); i++)
+            slots[order[i]] = i;
+        More().arena = new Node[items.size()];
+        extras->arenaSize = items.size();
+        extras->arenaLive = items.size();
+        root = Build_Balanced(items, 0, items.size(), NULL, 0, levels, slots);
+        Find_Extremes();
+    }
+    balance.After_Rebuild(*this);
+}
+
+// Record_Contents: a replay can't rebuild what it never saw, so a whole new
+// set of contents goes into the trace as a reset and one preload per item
+template <typename T, typename Policy, typename NodeType>
+void BalancedTree<T, Policy, NodeType>::Record_Contents(const vector<T>& items, bool reset){
+    if(Recorder() == NULL)
+        return;
+    if(reset)
+        Recorder()->Record(TRACE_RESET, T(), 0);
+    for(size_t i = 0; i < items.size(); i++)
+        Recorder()->Record(TRACE_INSERT, items[i], TRACE_HIT | TRACE_PRELOAD);
+}
+
+// Set_Recorder: the preloads go in sorted order, timed as they're written,
+// but a replay applies them before its clock starts
+template <typename T, typename Policy, typename NodeType>
+bool BalancedTree<T, Policy, NodeType>::Set_Recorder(TraceRecorder<T>* r){
+    if(r != NULL && !r->Is_Open())
+        return false;
+    if(r != NULL || extras != NULL)
+        More().recorder = r;
+    vector<T> items;
+    if(r != NULL)
+        Dump_To_Vector(items);
+    Record_Contents(items, false);
+    return true;
+}
+
+template <typename T, typename Policy, typename NodeType>
+bool BalancedTree<T, Policy, NodeType>::Set_Filter(bool on, int bitsPerItem){
+    if(extras != NULL){
+        delete extras->filter;
+        extras->filter = NULL;
+    }
+    if(!on || !Is_Hashable<T>::value)
+        return !on;
+    More().filterBits = bitsPerItem;
+    extras->filter = new BlockedBloomFilter<T>;
+    Rebuild_Filter();
+    return true;
+}
+
+template <typename T, typename Policy, typename NodeType>
+bool BalancedTree<T, Policy, NodeType>::Has_Filter() const{
+    return Filter() != NULL;
+}
+
+// Verify: a walk down with an explicit stack that only ever follows child
+// links, so broken parent links can't send it round in circles, and stops
+// once it has seen more nodes than the tree says it holds.  Each node gets
+// the bounds its ancestors set.  The policy's check only runs on a tree
+// whose links are known to be good
+template <typename T, typename Policy, typename NodeType>
+bool BalancedTree<T, Policy, NodeType>::Verify() const{
+    struct Frame{
+        Node* node;
+        const Node* low;  // every item here is >= low's, NULL for no bound
+        const Node* high; // and <= high's
+    };
+    const char* problem = NULL;
+    long nodes = 0;
+    long dead = 0;
+    bool fingerSeen = finger == NULL;
+    if(root != NULL && root->get_parent() != NULL)
+        problem = "the root has a parent";
+    vector<Frame> stack;
+    if(root != NULL){
+        Frame top = { root, NULL, NULL };
+        stack.push_back(top);
+    }
+    while(problem == NULL && !stack.empty()){
+        Frame f = stack.back();
+        stack.pop_back();
+        Node* node = f.node;
+        if(++nodes > nodeCount){
+            problem = "more nodes than nodeCount";
+            break;
+        }
+        dead += node->is_tombstone();
+        fingerSeen = fingerSeen || node == finger;
+        if((f.low != NULL && node->get_item() < f.low->get_item())
+           || (f.high != NULL && f.high->get_item() < node->get_item()))
+            problem = "an item is out of order";
+        else if(node->is_tombstone() && !lazyDeletes && !balance.Deferring())
+            problem = "a tombstone without lazy deletes or deferred ones";
+        else if(Filter() != NULL && !node->is_tombstone() && Filter_Rejects(node->get_item()))
+            problem = "the filter rejects an item that's there";
+        int height = 0;
+        Node* children[2] = { node->get_left(), node->get_right() };
+        for(int side = 0; side < 2 && problem == NULL; side++){
+            Node* child = children[side];
+            if(child == NULL)
+                continue;
+            if(child->get_parent() != node)
+                problem = "a child's parent link doesn't point back";
+            if constexpr(Node::KEEPS_HEIGHT){
+                if(child->get_height() > height)
+                    height = child->get_height();
+            }
+            Frame below = { child, side == 0 ? f.low : node, side == 0 ? node : f.high };
+            stack.push_back(below);
+        }
+        if constexpr(Node::KEEPS_HEIGHT){
+            if(problem == NULL && node->get_height() != height + 1)
+                problem = "a stored height is wrong";
+        }
+    }
+    if(problem == NULL){
+        Node* first = root;
+        Node* last = root;
+        while(first != NULL && first->get_left() != NULL)
+            first = first->get_left();
+        while(last != NULL && last->get_right() != NULL)
+            last = last->get_right();
+        if(nodes != nodeCount)
+            problem = "fewer nodes than nodeCount";
+        else if(dead != deadCount)
+            problem = "deadCount doesn't match the tombstones";
+        else if(leftmost != first || rightmost != last)
+            problem = "leftmost or rightmost isn't at the end";
+        else if(!fingerSeen)
+            problem = "the finger isn't in the tree";
+        else
+            problem = balance.Verify(*this);
+    }
+    if(problem != NULL)
+        cerr << "BalancedTree<" << Policy::Name() << ">::Verify: " << problem << endl;
+    return problem == NULL;
+}
+
+#ifdef RBTREE_STATS
+template <typename T, typename Policy, typename NodeType>
+const TreeStats& BalancedTree<T, Policy, NodeType>::Get_Stats() const{
+    return stats;
+}
+
+template <typename T, typename Policy, typename NodeType>
+void BalancedTree<T, Policy, NodeType>::Reset_Stats(){
+    stats.Reset();
+}
+#endif
+
+// Filter_Add: the filter is only ever made for hashable T, but every T
+// compiles the calls
+template <typename T, typename Policy, typename NodeType>
+void BalancedTree<T, Policy, NodeType>::Filter_Add(const T& x){
+    if constexpr(Is_Hashable<T>::value){
+        if(Filter() == NULL)
+            return;
+        extras->filter->Add(x);
+        extras->filterHeld++;
+    }
+}
+
+template <typename T, typename Policy, typename NodeType>
+bool BalancedTree<T, Policy, NodeType>::Filter_Rejects(const T& x) const{
+    if constexpr(Is_Hashable<T>::value){
+        if(Filter() != NULL && !extras->filter->May_Contain(x)){
+            RBTREE_STAT(stats.filterRejects++);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Reset_Filter: room for twice the items there are, or a thousand, so the
+// next rebuild is O(n) inserts away
+template <typename T, typename Policy, typename NodeType>
+void BalancedTree<T, Policy, NodeType>::Reset_Filter(){
+    if constexpr(Is_Hashable<T>::value){
+        long room = 2 * Size() > 1024 ? 2 * Size() : 1024;
+        extras->filter->Reset((size_t)room, extras->filterBits);
+        extras->filterHeld = 0;
+    }
+}
+
+template <typename T, typename Policy, typename NodeType>
+void BalancedTree<T, Policy, NodeType>::Rebuild_Filter(){
+    Reset_Filter();
+    Walk(root, INORDER, [this](Node* node, int){
+        if(!node->is_tombstone())
+            Filter_Add(node->get_item());
+    });
+}
+
+// Check_Filter: stale is more than half of what it holds being gone, plus
+// some slack so a small tree isn't rebuilt every few deletes
+template <typename T, typename Policy, typename NodeType>
+void BalancedTree<T, Policy, NodeType>::Check_Filter(){
+    if(extras->filterHeld > (long)extras->filter->Capacity() || extras->filterHeld > 2 * Size() + 1024)
+        Rebuild_Filter();
+}
+
+// Layout_Order: van Emde Boas splits the levels in half, lays out the top
+// half as a tree of its own, then every subtree hanging below it, each the
+// same way.  Whatever the cache line size, some level of that recursion has
+// subtrees that fit in one, so a root to leaf path crosses O(log_B n) lines
+template <typename T, typename Policy, typename NodeType>
+void BalancedTree<T, Policy, NodeType>::Layout_Order(size_t low, size_t high, int levels, vector<size_t>& order){
+    if(low >= high)
+        return;
+    if(levels == 1){
+        order.push_back(low + (high - low) / 2);
+        return;
+    }
+    int top = levels / 2;
+    Layout_Order(low, high, top, order);
+    vector<pair<size_t, size_t> > below;
+    Ranges_At_Depth(low, high, top, below);
+    for(size_t i = 0; i < below.size(); i++)
+        Layout_Order(below[i].first, below[i].second, levels - top, order);
+}
+
+template <typename T, typename Policy, typename NodeType>
+void BalancedTree<T, Policy, NodeType>::Ranges_At_Depth(size_t low, size_t high, int depth, vector<pair<size_t, size_t> >& ranges){
+    if(low >= high)
+        return;
+    if(depth == 0){
+        ranges.push_back(make_pair(low, high));
+        return;
+    }
+    size_t mid = low + (high - low) / 2;
+    Ranges_At_Depth(low, mid, depth - 1, ranges);
+    Ranges_At_Depth(mid + 1, high, depth - 1, ranges);
+}
+
+template <typename T, typename Policy, typename NodeType>
+typename BalancedTree<T, Policy, NodeType>::Node*
+BalancedTree<T, Policy, NodeType>::Build_Balanced(const vector<T>& items, size_t low, size_t high,
+                                                  Node* parent, int depth, int levels,
+                                                  const vector<size_t>& slots){
+    if(low >= high)
+        return NULL;
+    size_t mid = low + (high - low) / 2;
+    Node* node = extras->arena + slots[mid];
+    RBTREE_STAT(stats.allocations++);
+    node->set_item(items[mid]);
+    node->set_parent(parent);
+    node->set_left(Build_Balanced(items, low, mid, node, depth + 1, levels, slots));
+    node->set_right(Build_Balanced(items, mid + 1, high, node, depth + 1, levels, slots));
+    Update_Height(node);
+    balance.After_Build(*this, node, depth, levels);
+    return node;
+}
+
+// New_Node: inserts into a tree that's had deletes since its last Compact
+// fill the holes in the arena first, and stay next to their neighbours
+template <typename T, typename Policy, typename NodeType>
+typename BalancedTree<T, Policy, NodeType>::Node*
+BalancedTree<T, Policy, NodeType>::New_Node(){
+    if(extras == NULL || extras->arenaFree == NULL)
+        return new Node;
+    Node* node = extras->arenaFree;
+    extras->arenaFree = node->get_left();
+    *node = Node();
+    extras->arenaLive++;
+    return node;
+}
+
+// Free_Node: an arena node can't be deleted on its own, it goes on the free
+// list for New_Node.  Its item is reset so whatever it holds is released now
+template <typename T, typename Policy, typename NodeType>
+void BalancedTree<T, Policy, NodeType>::Free_Node(Node* node){
+    less<const Node*> before;
+    Node* arena = Arena();
+    if(arena == NULL || before(node, arena) || !before(node, arena + extras->arenaSize)){
+        delete node;
+        return;
+    }
+    node->set_item(T());
+    node->set_left(extras->arenaFree);
+    extras->arenaFree = node;
+    if(--extras->arenaLive == 0){
+        delete[] arena;
+        extras->arena = NULL;
+        extras->arenaSize = 0;
+        extras->arenaFree = NULL;
+    }
+}
+
+// Next_Node: compares pointers on the way up, the nodes don't remember
+// which side they hang on
+template <typename T, typename Policy, typename NodeType>
+typename BalancedTree<T, Policy, NodeType>::Node*
+BalancedTree<T, Policy, NodeType>::Next_Node(Node* node){
+    if(node->get_right() != NULL){
+        node = node->get_right();
+        while(node->get_left() != NULL)
+            node = node->get_left();
+        return node;
+    }
+    while(node->get_parent() != NULL && node->get_parent()->get_right() == node)
+        node = node->get_parent();
+    return node->get_parent();
+}
+
+template <typename T, typename Policy, typename NodeType>
+typename BalancedTree<T, Policy, NodeType>::Node*
+BalancedTree<T, Policy, NodeType>::Prev_Node(Node* node){
+    if(node->get_left() != NULL){
+        node = node->get_left();
+        while(node->get_right() != NULL)
+            node = node->get_right();
+        return node;
+    }
+    while(node->get_parent() != NULL && node->get_parent()->get_left() == node)
+        node = node->get_parent();
+    return node->get_parent();
+}
+
+template <typename T, typename Policy, typename NodeType>
+void BalancedTree<T, Policy, NodeType>::Find_Extremes(){
+    leftmost = root;
+    rightmost = root;
+    while(leftmost != NULL && leftmost->get_left() != NULL)
+        leftmost = leftmost->get_left();
+    while(rightmost != NULL && rightmost->get_right() != NULL)
+        rightmost = rightmost->get_right();
+}
+
+template <typename T, typename Policy, typename NodeType>
+void BalancedTree<T, Policy, NodeType>::Left_Rotate(Node* source, bool upward){
+    RBTREE_STAT(stats.leftRotations++);
+    Node* old_right = source->get_right();
+    source->set_right(old_right->get_left());
+    if(old_right->get_left() != NULL)
+        old_right->get_left()->set_parent(source);
+    Transplant(source, old_right);
+    old_right->set_left(source);
+    source->set_parent(old_right);
+    Fix_Rotated_Heights(source, old_right, upward);
+}
+
+template <typename T, typename Policy, typename NodeType>
+void BalancedTree<T, Policy, NodeType>::Right_Rotate(Node* source, bool upward){
+    RBTREE_STAT(stats.rightRotations++);
+    Node* old_left = source->get_left();
+    source->set_left(old_left->get_right());
+    if(old_left->get_right() != NULL)
+        old_left->get_right()->set_parent(source);
+    Transplant(source, old_left);
+    old_left->set_right(source);
+    source->set_parent(old_left);
+    Fix_Rotated_Heights(source, old_left, upward);
+}
+
+template <typename T, typename Policy, typename NodeType>
+void BalancedTree<T, Policy, NodeType>::Transplant(Node* old, Node* replacement){
+    Node* parent = old->get_parent();
+    if(parent == NULL)
+        root = replacement;
+    else if(parent->get_left() == old)
+        parent->set_left(replacement);
+    else
+        parent->set_right(replacement);
+    if(replacement != NULL)
+        replacement->set_parent(parent);
+}
+
+template <typename T, typename Policy, typename NodeType>
+int BalancedTree<T, Policy, NodeType>::Height_Of(Node* source){
+    if(source == NULL)
+        return 0;
+    return source->get_height();
+}
+
+template <typename T, typename Policy, typename NodeType>
+void BalancedTree<T, Policy, NodeType>::Update_Height(Node* source){
+    if constexpr(Node::KEEPS_HEIGHT){
+        int left = Height_Of(source->get_left());
+        int right = Height_Of(source->get_right());
+        source->set_height(1 + (left > right ? left : right));
+    }
+}
+
+// Update_Heights_Upward: once a node's height comes out unchanged nothing
+// above it can change either
+template <typename T, typename Policy, typename NodeType>
+void BalancedTree<T, Policy, NodeType>::Update_Heights_Upward(Node* source){
+    if constexpr(Node::KEEPS_HEIGHT){
+        while(source != NULL){
+            int before = source->get_height();
+            Update_Height(source);
+            if(source->get_height() == before)
+                return;
+            source = source->get_parent();
+        }
+    }
+}
+
+// Fix_Rotated_Heights: "down" still has the height the whole subtree had
+// before the rotation, so it's what the new top is compared against
+template <typename T, typename Policy, typename NodeType>
+void BalancedTree<T, Policy, NodeType>::Fix_Rotated_Heights(Node* down, Node* up, bool upward){
+    if constexpr(Node::KEEPS_HEIGHT){
+        int oldHeight = down->get_height();
+        Update_Height(down);
+        Update_Height(up);
+        if(upward && up->get_height() != oldHeight)
+            Update_Heights_Upward(up->get_parent());
+    }
+}
+
+template <typename T, typename Policy, typename NodeType>
+typename BalancedTree<T, Policy, NodeType>::Node*
+BalancedTree<T, Policy, NodeType>::Find_Node(const T& x, Node*& last) const{
+    Node* cur = root;
+    last = NULL;
+    while(cur != NULL){
+        RBTREE_STAT(stats.Hop());
+        RBTREE_STAT(stats.comparisons++);
+        last = cur;
+        if(cur->get_item() == x)
+            return cur;
+        RBTREE_STAT(stats.comparisons++);
+        if(cur->get_item() < x)
+            cur = cur->get_right();
+        else
+            cur = cur->get_left();
+    }
+    return NULL;
+}
+
+template <typename T, typename Policy, typename NodeType>
+bool BalancedTree<T, Policy, NodeType>::Find_Helper(Node* source, const T& x) const{
+    while(source != NULL){
+        RBTREE_STAT(stats.Hop());
+        RBTREE_STAT(stats.comparisons++);
+        if(source->get_item() == x)
+            return true;
+        RBTREE_STAT(stats.comparisons++);
+        if(source->get_item() < x)
+            source = source->get_right();
+        else
+            source = source->get_left();
+    }
+    return false;
+}
+
+// Find_Marked: equal items can sit on both sides of each other after
+// rotations, so go to the first one in order and step through the run
+template <typename T, typename Policy, typename NodeType>
+typename BalancedTree<T, Policy, NodeType>::Node*
+BalancedTree<T, Policy, NodeType>::Find_Marked(const T& x, bool tombstone) const{
+    Node* cur = root;
+    Node* first = NULL;
+    while(cur != NULL){
+        RBTREE_STAT(stats.Hop());
+        RBTREE_STAT(stats.comparisons++);
+        if(cur->get_item() >= x){
+            first = cur;
+            cur = cur->get_left();
+        }
+        else
+            cur = cur->get_right();
+    }
+    while(first != NULL && first->get_item() == x){
+        if(first->is_tombstone() == tombstone)
+            return first;
+        first = Next_Node(first);
+    }
+    return NULL;
+}
+
+// Find_Insert_Position: equal items go left
+template <typename T, typename Policy, typename NodeType>
+typename BalancedTree<T, Policy, NodeType>::Node*
+BalancedTree<T, Policy, NodeType>::Find_Insert_Position(Node* start, const T& x) const{
+    Node* parent = NULL;
+    Node* cur = start;
+    while(cur != NULL){
+        RBTREE_STAT(stats.Hop());
+        RBTREE_STAT(stats.comparisons++);
+        parent = cur;
+        cur = cur->get_item() >= x ? cur->get_left() : cur->get_right();
+    }
+    return parent;
+}
+
+// Print_Depth_Helper: walks down d levels from source and prints what's there
+template <typename T, typename Policy, typename NodeType>
+void BalancedTree<T, Policy, NodeType>::Print_Depth_Helper(Node* source, int d) const{
+    if(source != NULL){
+        if(d == 0){
+            if(!source->is_tombstone())
+                cout << source->get_item() << " ";
+        }
+        else{
+            Print_Depth_Helper(source->get_left(), d - 1);
+            Print_Depth_Helper(source->get_right(), d - 1);
+        }
+    }
+}
+
+template <typename T, typename Policy, typename NodeType>
+template <typename OutputIt>
+OutputIt BalancedTree<T, Policy, NodeType>::Dump_Helper(Node* source, OutputIt out) const{
+    Walk(source, INORDER, [&out](Node* node, int){
+        if(!node->is_tombstone()){
+            *out = node->get_item();
+            ++out;
+        }
+    });
+    return out;
+}
+
+// Cut_Pieces: recurses at most "levels" deep
+template <typename T, typename Policy, typename NodeType>
+void BalancedTree<T, Policy, NodeType>::Cut_Pieces(Node* source, int levels, vector<pair<Node*, bool> >& pieces) const{
+    if(source == NULL)
+        return;
+    if(levels == 0){
+        pieces.push_back(make_pair(source, true));
+        return;
+    }
+    Cut_Pieces(source->get_left(), levels - 1, pieces);
+    pieces.push_back(make_pair(source, false));
+    Cut_Pieces(source->get_right(), levels - 1, pieces);
+}
+
+// Run_Pieces: one shared counter hands out the pieces, so a thread that
+// drew small ones just comes back for more.  The calling thread is one of
+// the workers
+template <typename T, typename Policy, typename NodeType>
+template <typename Work>
+void BalancedTree<T, Policy, NodeType>::Run_Pieces(int threads, size_t count, Work work){
+    atomic<size_t> next(0);
+    auto run = [&next, count, &work]{
+        for(size_t i = next++; i < count; i = next++)
+            work(i);
+    };
+    vector<thread> pool;
+    for(int t = 1; t < threads; t++)
+        pool.push_back(thread(run));
+    run();
+    for(size_t t = 0; t < pool.size(); t++)
+        pool[t].join();
+}
+
+// Walk: "prev" remembers where we came from.  Arriving from the parent is
+// the first visit, from the left child the second, from the right child the
+// last, which is all the state a recursive traversal would have kept
+template <typename T, typename Policy, typename NodeType>
+template <typename Visitor>
+void BalancedTree<T, Policy, NodeType>::Walk(Node* source, WalkOrder order, Visitor visit) const{
+    if(source == NULL)
+        return;
+    Node* stop = source->get_parent();
+    Node* prev = stop;
+    Node* cur = source;
+    int depth = 0;
+    while(cur != stop){
+        Node* next;
+        if(prev == cur->get_parent()){ // first time here
+            if(order == PREORDER)
+                visit(cur, depth);
+            if(cur->get_left() != NULL)
+                next = cur->get_left();
+            else{
+                if(order == INORDER)
+                    visit(cur, depth);
+                next = cur->get_right() != NULL ? cur->get_right() : cur->get_parent();
+            }
+        }
+        else if(prev == cur->get_left() && prev != NULL){ // back from the left
+            if(order == INORDER)
+                visit(cur, depth);
+            next = cur->get_right() != NULL ? cur->get_right() : cur->get_parent();
+        }
+        else // back from the right
+            next = cur->get_parent();
+
+        if(next == cur->get_parent()){ // leaving for good
+            if(order == POSTORDER)
+                visit(cur, depth);
+            depth--;
+        }
+        else
+            depth++;
+        prev = cur;
+        cur = next;
+    }
+}
+
+// Delete_Tree: deletes the subtree at "source" a leaf at a time.  Climbing
+// back to the parent after each leaf keeps it O(n) with no stack, so even a
+// degenerate tree can't overflow it
+template <typename T, typename Policy, typename NodeType>
+void BalancedTree<T, Policy, NodeType>::Delete_Tree(Node* source){
+    Free_Subtree(source, [this](Node* node){
+        Free_Node(node);
+        RBTREE_STAT(stats.frees++);
+    });
+}
+
+template <typename T, typename Policy, typename NodeType>
+template <typename Free>
+void BalancedTree<T, Policy, NodeType>::Free_Subtree(Node* source, Free free){
+    if(source == NULL)
+        return;
+    Node* stop = source->get_parent();
+    Node* cur = source;
+    while(cur != stop){
+        if(cur->get_left() != NULL)
+            cur = cur->get_left();
+        else if(cur->get_right() != NULL)
+            cur = cur->get_right();
+        else{ // a leaf, unhook it from its parent and go back up
+            Node* parent = cur->get_parent();
+            if(parent != NULL){
+                if(parent->get_left() == cur)
+                    parent->set_left(NULL);
+                else
+                    parent->set_right(NULL);
+            }
+            free(cur);
+            if(cur == source)
+                return;
+            cur = parent;
+        }
+    }
+}
+
+// Copy_Tree: walks source and the copy in lockstep, using the copy's own
+// parent pointers to climb back up
+template <typename T, typename Policy, typename NodeType>
+typename BalancedTree<T, Policy, NodeType>::Node*
+BalancedTree<T, Policy, NodeType>::Copy_Tree(Node* source){
+    if(source == NULL)
+        return NULL;
+    Node* top = new Node;
+    RBTREE_STAT(stats.allocations++);
+    top->set_item(source->get_item());
+    top->set_rank(source->get_rank());
+    if constexpr(Node::KEEPS_HEIGHT)
+        top->set_height(source->get_height());
+    top->set_tombstone(source->is_tombstone());
+
+    Node* from = source;
+    Node* to = top;
+    while(true){
+        Node* next = NULL;
+        bool left = false;
+        if(from->get_left() != NULL && to->get_left() == NULL){
+            next = from->get_left();
+            left = true;
+        }
+        else if(from->get_right() != NULL && to->get_right() == NULL)
+            next = from->get_right();
+
+        if(next != NULL){ // copy the child and step down into it
+            Node* p = new Node;
+            RBTREE_STAT(stats.allocations++);
+            p->set_item(next->get_item());
+            p->set_rank(next->get_rank());
+            if constexpr(Node::KEEPS_HEIGHT)
+                p->set_height(next->get_height());
+            p->set_tombstone(next->is_tombstone());
+            p->set_parent(to);
+            if(left)
+                to->set_left(p);
+            else
+                to->set_right(p);
+            from = next;
+            to = p;
+        }
+        else if(from == source) // both children done at the top
+            break;
+        else{
+            from = from->get_parent();
+            to = to->get_parent();
+        }
+    }
+    return top;
+}
+
+#include "balancepolicies.h"
+
+#endif
@@ -0,0 +1,149 @@
+//
+//  balancedtreenode.h
+//  RedBlackTree
+//
+//  Node for BalancedTree.  Besides the links it carries one int, "rank",
+//  whose meaning belongs to the balancing policy: a color for red-black, the
+//  rank for WAVL, the heap priority for a treap.  The height of its subtree
+//  and the tombstone mark are the tree's own; AVL balances on that height
+//  and leaves rank alone.
+//
+
+#ifndef BalancedTreeNode_H
+#define BalancedTreeNode_H
+#include <cstdlib>
+
+using namespace std;
+
+template <typename T>
+class BalancedTreeNode{
+public:
+    BalancedTreeNode();
+    ~BalancedTreeNode();
+
+    // BalancedTree keeps get_height up to date, see treenode.h for one that
+    // doesn't have it
+    static const bool KEEPS_HEIGHT = true;
+
+    // accessors
+    const T& get_item() const;
+    BalancedTreeNode<T>* get_parent() const;
+    BalancedTreeNode<T>* get_left() const;
+    BalancedTreeNode<T>* get_right() const;
+    int get_rank() const;
+    // height of the subtree rooted here, a lone node being 1
+    int get_height() const;
+    // deleted but still linked in, see BalancedTree::Set_Lazy_Delete
+    bool is_tombstone() const;
+
+    // mutators
+    void set_item(const T& new_item);
+    void set_parent(BalancedTreeNode<T>* new_parent);
+    void set_left(BalancedTreeNode<T>* new_left);
+    void set_right(BalancedTreeNode<T>* new_right);
+    void set_rank(const int& new_rank);
+    void set_height(const int& h);
+    void set_tombstone(const bool& dead);
+
+private:
+    T item;
+    int rank; // next to a 4 byte item, so an int node stays 40 bytes
+    BalancedTreeNode<T>* parent;
+    BalancedTreeNode<T>* left;
+    BalancedTreeNode<T>* right;
+    int height;
+    bool tombstone;
+};
+
+
+// default constrctor, sets the pointers to NULL
+template <typename T>
+BalancedTreeNode<T>::BalancedTreeNode(){
+    parent = NULL;
+    left = NULL;
+    right = NULL;
+    rank = 0;
+    height = 1;
+    tombstone = false;
+}
+
+// destructor.  Like the other nodes it doesn't delete recursively
+template <typename T>
+BalancedTreeNode<T>::~BalancedTreeNode(){
+    left = NULL;
+    right = NULL;
+}
+
+// accessor functions to get the parts of the node
+template <typename T>
+const T& BalancedTreeNode<T>::get_item() const{
+    return item;
+}
+
+template <typename T>
+BalancedTreeNode<T>* BalancedTreeNode<T>::get_parent() const{
+    return parent;
+}
+
+template <typename T>
+BalancedTreeNode<T>* BalancedTreeNode<T>::get_left() const{
+    return left;
+}
+
+template <typename T>
+BalancedTreeNode<T>* BalancedTreeNode<T>::get_right() const{
+    return right;
+}
+
+template <typename T>
+int BalancedTreeNode<T>::get_rank() const{
+    return rank;
+}
+
+template <typename T>
+int BalancedTreeNode<T>::get_height() const{
+    return height;
+}
+
+template <typename T>
+bool BalancedTreeNode<T>::is_tombstone() const{
+    return tombstone;
+}
+
+// mutator functions to set the parts of the node
+template <typename T>
+void BalancedTreeNode<T>::set_item(const T& new_item){
+    item = new_item;
+}
+
+template <typename T>
+void BalancedTreeNode<T>::set_parent(BalancedTreeNode<T>* new_parent){
+    parent = new_parent;
+}
+
+template <typename T>
+void BalancedTreeNode<T>::set_left(BalancedTreeNode<T>* new_left){
+    left = new_left;
+}
+
+template <typename T>
+void BalancedTreeNode<T>::set_right(BalancedTreeNode<T>* new_right){
+    right = new_right;
+}
+
+template <typename T>
+void BalancedTreeNode<T>::set_rank(const int& new_rank){
+    rank = new_rank;
+}
+
+template <typename T>
+void BalancedTreeNode<T>::set_height(const int& h){
+    height = h;
+}
+
+template <typename T>
+void BalancedTreeNode<T>::set_tombstone(const bool& dead){
+    tombstone = dead;
+}
+
+#endif
@@ -0,0 +1,724 @@
+//
+//  balancepolicies.h
+//  RedBlackTree
+//
+//  The balancing policies for BalancedTree, and a short alias for each.
+//  Included by balancedtree.h, don't include it on its own.
+//
+//  Roughly: AVL keeps the shallowest tree and so has the cheapest lookups,
+//  but rotates more on updates; red-black and WAVL rotate at most two or
+//  three times per update; the treap is balanced only in expectation, but
+//  its updates are the simplest.  Splay is the odd one out: it reshapes
+//  itself on every Access, which pays off when a few keys get most of them.
+//
+
+#ifndef BalancePolicies_H
+#define BalancePolicies_H
+
+#include <cstdint>
+
+// Every policy derives from this: a hook it doesn't define does nothing
+struct BalancePolicy{
+    template <typename Tree>
+    void Init(Tree&, typename Tree::Node*){}
+
+    template <typename Tree>
+    void After_Insert(Tree&, typename Tree::Node*){}
+
+    template <typename Tree>
+    void Before_Delete(Tree&, typename Tree::Node*){}
+
+    template <typename Tree>
+    void After_Delete(Tree&, typename Tree::Node*, bool, int){}
+
+    template <typename Tree>
+    void After_Access(Tree&, typename Tree::Node*){}
+
+    template <typename Tree>
+    void After_Build(Tree&, typename Tree::Node*, int, int){}
+
+    template <typename Tree>
+    void After_Rebuild(Tree&){}
+
+    bool Deferring() const{ return false; }
+
+    template <typename Tree>
+    const char* Verify(const Tree&) const{ return NULL; }
+};
+
+
+// No balancing at all, the shape Tree<T> builds while it isn't randomized
+struct NoBalance : BalancePolicy{
+    static const char* Name(){ return "none"; }
+};
+
+
+// Red-black: rank 1 is black, 0 is red.  Missing children count as black.
+// It can also run relaxed, after chromatic trees: an insert only notes the
+// red-red violation it made, if any, in the tree's "unfixed" list, and a
+// delete only tombstones its node, both left for Rebalance_Step to fix a
+// bounded amount at a time
+struct RedBlackBalance : BalancePolicy{
+    static const char* Name(){ return "red-black"; }
+
+    RedBlackBalance() : relaxed(false){}
+
+    template <typename Node>
+    static bool Is_Black(Node* n){ return n == NULL || n->get_rank() == 1; }
+
+    template <typename Tree>
+    void Init(Tree&, typename Tree::Node* n){
+        n->set_rank(0);
+    }
+
+    template <typename Tree>
+    void After_Insert(Tree& t, typename Tree::Node* n){
+        if(!relaxed){
+            while(n != NULL)
+                n = Insert_Fixup_Step(t, n);
+        }
+        else if(n->get_parent() == NULL) // a new root can simply be black
+            n->set_rank(1);
+        else if(!Is_Black(n->get_parent())) // leave it for Rebalance_Step
+            t.Unfixed().push_back(n);
+    }
+
+    // One pass of the insert fixup, the usual three cases: a red uncle
+    // recolors and moves the problem up to the grandparent, which is
+    // returned, otherwise one or two rotations end it.  Returns NULL once
+    // n's parent is black, which is when the root is blackened too
+    template <typename Tree>
+    static typename Tree::Node* Insert_Fixup_Step(Tree& t, typename Tree::Node* n){
+        typedef typename Tree::Node Node;
+        Node* parent = n->get_parent();
+        Node* grand = parent == NULL ? NULL : parent->get_parent();
+        if(grand == NULL || Is_Black(parent)){ // nothing over red but maybe the root
+            t.root->set_rank(1);
+            return NULL;
+        }
+        bool parentLeft = grand->get_left() == parent;
+        Node* uncle = parentLeft ? grand->get_right() : grand->get_left();
+        if(!Is_Black(uncle)){
+            parent->set_rank(1);
+            uncle->set_rank(1);
+            grand->set_rank(0);
+            RBTREE_STAT(t.stats.insertRecolors += 3);
+            return grand;
+        }
+        if(n == (parentLeft ? parent->get_right() : parent->get_left())){ // inside, turn it outside
+            if(parentLeft)
+                t.Left_Rotate(parent);
+            else
+                t.Right_Rotate(parent);
+            n = parent;
+            parent = n->get_parent();
+        }
+        parent->set_rank(1);
+        grand->set_rank(0);
+        RBTREE_STAT(t.stats.insertRecolors += 2);
+        if(parentLeft)
+            t.Right_Rotate(grand);
+        else
+            t.Left_Rotate(grand);
+        return n;
+    }
+
+    // "x" carries the extra black.  It can be NULL, so its parent and side
+    // are tracked alongside it instead of borrowing a stand-in node
+    template <typename Tree>
+    void After_Delete(Tree& t, typename Tree::Node* parent, bool left, int removedRank){
+        typedef typename Tree::Node Node;
+        if(removedRank == 0) // took a red node out, nothing changed
+            return;
+        Node* x = parent == NULL ? t.root : (left ? parent->get_left() : parent->get_right());
+        while(parent != NULL && Is_Black(x)){
+            if(left){
+                Node* sibling = parent->get_right();
+                if(!Is_Black(sibling)){
+                    sibling->set_rank(1);
+                    parent->set_rank(0);
+                    RBTREE_STAT(t.stats.deleteRecolors += 2);
+                    t.Left_Rotate(parent);
+                    sibling = parent->get_right();
+                }
+                if(Is_Black(sibling->get_left()) && Is_Black(sibling->get_right())){
+                    sibling->set_rank(0);
+                    RBTREE_STAT(t.stats.deleteRecolors++);
+                    x = parent;
+                }
+                else{
+                    if(Is_Black(sibling->get_right())){
+                        sibling->get_left()->set_rank(1);
+                        sibling->set_rank(0);
+                        RBTREE_STAT(t.stats.deleteRecolors += 2);
+                        t.Right_Rotate(sibling);
+                        sibling = parent->get_right();
+                    }
+                    sibling->set_rank(parent->get_rank());
+                    parent->set_rank(1);
+                    sibling->get_right()->set_rank(1);
+                    RBTREE_STAT(t.stats.deleteRecolors += 3);
+                    t.Left_Rotate(parent);
+                    x = t.root;
+                }
+            }
+            else{
+                Node* sibling = parent->get_left();
+                if(!Is_Black(sibling)){
+                    sibling->set_rank(1);
+                    parent->set_rank(0);
+                    RBTREE_STAT(t.stats.deleteRecolors += 2);
+                    t.Right_Rotate(parent);
+                    sibling = parent->get_left();
+                }
+                if(Is_Black(sibling->get_left()) && Is_Black(sibling->get_right())){
+                    sibling->set_rank(0);
+                    RBTREE_STAT(t.stats.deleteRecolors++);
+                    x = parent;
+                }
+                else{
+                    if(Is_Black(sibling->get_left())){
+                        sibling->get_right()->set_rank(1);
+                        sibling->set_rank(0);
+                        RBTREE_STAT(t.stats.deleteRecolors += 2);
+                        t.Left_Rotate(sibling);
+                        sibling = parent->get_left();
+                    }
+                    sibling->set_rank(parent->get_rank());
+                    parent->set_rank(1);
+                    sibling->get_left()->set_rank(1);
+                    RBTREE_STAT(t.stats.deleteRecolors += 3);
+                    t.Right_Rotate(parent);
+                    x = t.root;
+                }
+            }
+            parent = x->get_parent();
+            left = parent != NULL && parent->get_left() == x;
+        }
+        if(x != NULL)
+            x->set_rank(1);
+    }
+
+    // the leaves are all on the two deepest levels; making the deepest one
+    // red gives every path the same number of black nodes
+    template <typename Tree>
+    void After_Build(Tree&, typename Tree::Node* n, int depth, int levels){
+        n->set_rank(depth == levels - 1 && depth > 0 ? 0 : 1);
+    }
+
+    // a copy finds its own violations and tombstones again; a tree built
+    // from sorted items has none
+    template <typename Tree>
+    void After_Rebuild(Tree& t){
+        typedef typename Tree::Node Node;
+        bool relaxedNow = relaxed;
+        t.Walk(t.root, Tree::PREORDER, [&t, relaxedNow](Node* node, int){
+            if(!Is_Black(node) && !Is_Black(node->get_parent()))
+                t.Unfixed().push_back(node);
+            if(node->is_tombstone() && relaxedNow)
+                t.Deferred().push_back(node);
+        });
+    }
+
+    bool Deferring() const{ return relaxed; }
+
+    void Set_Relaxed(bool on){ relaxed = on; }
+
+    bool Is_Relaxed() const{ return relaxed; }
+
+    // Rebalance_Step: the insert fixup assumes the grandparent is black, which
+    // only holds for the topmost of a chain of reds, so each pass works on
+    // that one and leaves the rest queued.  A pass can only move a violation
+    // up to the grandparent it returns, or onto a node that was already
+    // queued.  The delete fixup needs a proper red-black tree, so the
+    // tombstones wait until every violation is gone; unlinking one frees only
+    // that node, which keeps the other queued pointers good
+    template <typename Tree>
+    int Rebalance_Step(Tree& t, int budget){
+        typedef typename Tree::Node Node;
+        if(t.Pending() == 0){ // nothing to do, and no lists to make for it
+            if(t.root != NULL)
+                t.root->set_rank(1);
+            return 0;
+        }
+        vector<Node*>& unfixed = t.Unfixed();
+        vector<Node*>& deferred = t.Deferred();
+        for(; budget > 0; budget--){
+            if(!unfixed.empty()){
+                Node* source = unfixed.back();
+                if(Is_Black(source) || Is_Black(source->get_parent())){
+                    unfixed.pop_back(); // fixed along the way
+                    continue;
+                }
+                Node* top = source;
+                while(!Is_Black(top->get_parent()->get_parent()))
+                    top = top->get_parent();
+                if(top == source)
+                    unfixed.pop_back();
+                if(top->get_parent() == t.root){ // a red root can simply turn black
+                    t.root->set_rank(1);
+                    continue;
+                }
+                Node* next = Insert_Fixup_Step(t, top);
+                if(next != NULL)
+                    unfixed.push_back(next);
+            }
+            else if(!deferred.empty()){
+                Node* kill = deferred.back();
+                deferred.pop_back();
+                t.deadCount--;
+                t.Unlink(kill);
+            }
+            else
+                break;
+        }
+        if(unfixed.empty() && t.root != NULL)
+            t.root->set_rank(1);
+        return (int)(unfixed.size() + deferred.size());
+    }
+
+    // every path down has the same number of black nodes, red over red only
+    // while relaxed mode has fixups pending, and a black root
+    template <typename Tree>
+    const char* Verify(const Tree& t) const{
+        typedef typename Tree::Node Node;
+        bool redOverRed = relaxed && t.Has_Unfixed();
+        int leafBlacks = -1;
+        vector<pair<Node*, int> > stack; // a node and the black nodes above it
+        if(t.root != NULL)
+            stack.push_back(make_pair(t.root, 0));
+        while(!stack.empty()){
+            Node* node = stack.back().first;
+            int blacks = stack.back().second + Is_Black(node);
+            stack.pop_back();
+            if(node->get_rank() != 0 && node->get_rank() != 1)
+                return "a rank isn't a color";
+            Node* children[2] = { node->get_left(), node->get_right() };
+            for(int side = 0; side < 2; side++){
+                if(children[side] == NULL){
+                    if(leafBlacks < 0)
+                        leafBlacks = blacks;
+                    else if(leafBlacks != blacks)
+                        return "two paths have different black heights";
+                }
+                else if(!Is_Black(node) && !Is_Black(children[side]) && !redOverRed)
+                    return "a red node has a red child";
+                else
+                    stack.push_back(make_pair(children[side], blacks));
+            }
+        }
+        if(!Is_Black(t.root) && !redOverRed)
+            return "the root is red";
+        return NULL;
+    }
+
+private:
+    bool relaxed;
+};
+
+
+// AVL: balanced on the subtree heights the core already keeps in every
+// node, so rank isn't used
+struct AVLBalance : BalancePolicy{
+    static const char* Name(){ return "avl"; }
+
+    template <typename Node>
+    static int Height_Of(Node* n){
+        static_assert(Node::KEEPS_HEIGHT, "AVL balances on the stored heights");
+        return n == NULL ? 0 : n->get_height();
+    }
+
+    template <typename Tree>
+    void After_Insert(Tree& t, typename Tree::Node* n){
+        typename Tree::Node* parent = n->get_parent();
+        Retrace(t, parent, parent != NULL && parent->get_left() == n, true);
+    }
+
+    template <typename Tree>
+    void After_Delete(Tree& t, typename Tree::Node* parent, bool left, int){
+        Retrace(t, parent, left, false);
+    }
+
+    // no two children's heights differ by more than one
+    template <typename Tree>
+    const char* Verify(const Tree& t) const{
+        typedef typename Tree::Node Node;
+        const char* problem = NULL;
+        t.Walk(t.root, Tree::PREORDER, [&problem](Node* node, int){
+            int balance = Height_Of(node->get_left()) - Height_Of(node->get_right());
+            if(balance > 1 || balance < -1)
+                problem = "a node is out of balance";
+        });
+        return problem;
+    }
+
+    // Retrace: parent's child on the "left" side has just grown or shrunk by
+    // one.  The core has already fixed every stored height above it, so all
+    // that's left is to rotate where that put a node out of balance, and to
+    // know when to stop: once a subtree comes out the height it had before,
+    // nothing above it can have changed.  After an insert that's at the
+    // latest the first rotation
+    template <typename Tree>
+    static void Retrace(Tree& t, typename Tree::Node* parent, bool left, bool grew){
+        typedef typename Tree::Node Node;
+        while(parent != NULL){
+            Node* child = left ? parent->get_left() : parent->get_right();
+            Node* sibling = left ? parent->get_right() : parent->get_left();
+            int lean = Height_Of(child) - Height_Of(sibling);
+            if(lean > 1 || lean < -1){
+                int before = parent->get_height();
+                parent = Rebalance(t, parent);
+                if(grew || parent->get_height() == before)
+                    return;
+            }
+            else if(lean != (grew ? 1 : 0)) // the other side sets parent's height
+                return;
+            Node* above = parent->get_parent();
+            left = above != NULL && above->get_left() == parent;
+            parent = above;
+        }
+    }
+
+    // Rebalance: one or two rotations for a node whose children's heights
+    // differ by two; the rotations fix the heights.  Returns whatever is now
+    // on top of n's old subtree
+    template <typename Tree>
+    static typename Tree::Node* Rebalance(Tree& t, typename Tree::Node* n){
+        typedef typename Tree::Node Node;
+        if(Height_Of(n->get_left()) > Height_Of(n->get_right())){
+            Node* l = n->get_left();
+            if(Height_Of(l->get_left()) < Height_Of(l->get_right()))
+                t.Left_Rotate(l, false); // the rotation at n recomputes the rest
+            t.Right_Rotate(n);
+        }
+        else{
+            Node* r = n->get_right();
+            if(Height_Of(r->get_right()) < Height_Of(r->get_left()))
+                t.Right_Rotate(r, false);
+            t.Left_Rotate(n);
+        }
+        return n->get_parent();
+    }
+};
+
+
+// WAVL (Haeupler, Sen and Tarjan's weak AVL): every rank difference between
+// a node and a child is 1 or 2, leaves have rank 0, missing children rank -1.
+// Insert-only it builds exactly the AVL shape, but a delete never does more
+// than two rotations
+struct WAVLBalance : BalancePolicy{
+    static const char* Name(){ return "wavl"; }
+
+    template <typename Node>
+    static int Rank_Of(Node* n){ return n == NULL ? -1 : n->get_rank(); }
+
+    template <typename Node>
+    static void Promote(Node* n, int by = 1){ n->set_rank(n->get_rank() + by); }
+
+    template <typename Node>
+    static void Demote(Node* n, int by = 1){ n->set_rank(n->get_rank() - by); }
+
+    template <typename Tree>
+    void Init(Tree&, typename Tree::Node* n){
+        n->set_rank(0);
+    }
+
+    // n is a 0-child as long as it has its parent's rank.  A 0,1 parent gets
+    // promoted and the problem moves up; a 0,2 parent ends it with a rotation
+    template <typename Tree>
+    void After_Insert(Tree& t, typename Tree::Node* n){
+        typedef typename Tree::Node Node;
+        Node* parent = n->get_parent();
+        while(parent != NULL && parent->get_rank() == n->get_rank()){
+            bool left = parent->get_left() == n;
+            Node* sibling = left ? parent->get_right() : parent->get_left();
+            if(parent->get_rank() - Rank_Of(sibling) == 1){
+                Promote(parent);
+                n = parent;
+                parent = n->get_parent();
+                continue;
+            }
+            Node* inner = left ? n->get_right() : n->get_left();
+            if(n->get_rank() - Rank_Of(inner) == 2){ // single rotation
+                if(left)
+                    t.Right_Rotate(parent);
+                else
+                    t.Left_Rotate(parent);
+                Demote(parent);
+            }
+            else{ // double rotation through the inner grandchild
+                if(left){
+                    t.Left_Rotate(n);
+                    t.Right_Rotate(parent);
+                }
+                else{
+                    t.Right_Rotate(n);
+                    t.Left_Rotate(parent);
+                }
+                Promote(inner);
+                Demote(n);
+                Demote(parent);
+            }
+            return;
+        }
+    }
+
+    // A parent left as a 2,2 leaf is demoted first.  After that x is a
+    // 3-child while the problem persists: a 2-child sibling, or a 1-child
+    // sibling whose children are both 2-children, means demoting and moving
+    // up; anything else ends it with one or two rotations
+    template <typename Tree>
+    void After_Delete(Tree& t, typename Tree::Node* parent, bool left, int){
+        typedef typename Tree::Node Node;
+        if(parent == NULL)
+            return;
+        Node* x = left ? parent->get_left() : parent->get_right();
+        if(parent->get_left() == NULL && parent->get_right() == NULL && parent->get_rank() == 1){
+            Demote(parent);
+            x = parent;
+            parent = x->get_parent();
+            left = parent != NULL && parent->get_left() == x;
+        }
+        while(parent != NULL && parent->get_rank() - Rank_Of(x) == 3){
+            Node* sibling = left ? parent->get_right() : parent->get_left();
+            if(parent->get_rank() - Rank_Of(sibling) == 2)
+                Demote(parent);
+            else if(sibling->get_rank() - Rank_Of(sibling->get_left()) == 2
+                    && sibling->get_rank() - Rank_Of(sibling->get_right()) == 2){
+                Demote(parent);
+                Demote(sibling);
+            }
+            else{
+                Node* outer = left ? sibling->get_right() : sibling->get_left();
+                Node* inner = left ? sibling->get_left() : sibling->get_right();
+                if(sibling->get_rank() - Rank_Of(outer) == 1){ // single rotation
+                    if(left)
+                        t.Left_Rotate(parent);
+                    else
+                        t.Right_Rotate(parent);
+                    Promote(sibling);
+                    Demote(parent);
+                    if(parent->get_left() == NULL && parent->get_right() == NULL)
+                        Demote(parent); // no 2,2 leaves
+                }
+                else{ // double rotation through the inner nephew
+                    if(left){
+                        t.Right_Rotate(sibling);
+                        t.Left_Rotate(parent);
+                    }
+                    else{
+                        t.Left_Rotate(sibling);
+                        t.Right_Rotate(parent);
+                    }
+                    Promote(inner, 2);
+                    Demote(sibling);
+                    Demote(parent, 2);
+                }
+                return;
+            }
+            x = parent;
+            parent = x->get_parent();
+            left = parent != NULL && parent->get_left() == x;
+        }
+    }
+
+    // a perfectly balanced tree is an AVL tree, ranked by height
+    template <typename Tree>
+    void After_Build(Tree&, typename Tree::Node* n, int, int){
+        static_assert(Tree::Node::KEEPS_HEIGHT, "WAVL ranks a built tree by its heights");
+        n->set_rank(n->get_height() - 1);
+    }
+
+    template <typename Tree>
+    const char* Verify(const Tree& t) const{
+        typedef typename Tree::Node Node;
+        const char* problem = NULL;
+        t.Walk(t.root, Tree::PREORDER, [&problem](Node* node, int){
+            int left = node->get_rank() - Rank_Of(node->get_left());
+            int right = node->get_rank() - Rank_Of(node->get_right());
+            if(problem == NULL && (left < 1 || left > 2 || right < 1 || right > 2))
+                problem = "a rank difference isn't 1 or 2";
+            else if(problem == NULL && node->get_left() == NULL && node->get_right() == NULL
+                    && node->get_rank() != 0)
+                problem = "a leaf's rank isn't 0";
+        });
+        return problem;
+    }
+};
+
+
+// Treap: rank is a random priority kept in max-heap order, so the shape is
+// that of a random insertion order whatever order the keys come in.  It can
+// be switched off, and then it balances no more than NoBalance; the
+// priorities are still handed out, but only mean anything once the tree is
+// rebuilt with the switch on
+struct TreapBalance : BalancePolicy{
+    static const char* Name(){ return "treap"; }
+
+    TreapBalance() : state(0x9E3779B9u), active(true){}
+
+    // xorshift32, plenty for priorities
+    int Next_Priority(){
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return (int)(state & 0x7FFFFFFFu);
+    }
+
+    // xorshift is stuck at zero, so zero keeps the default
+    void Seed(uint32_t seed){
+        state = seed != 0 ? seed : 0x9E3779B9u;
+    }
+
+    void Set_Active(bool on){ active = on; }
+
+    bool Is_Active() const{ return active; }
+
+    template <typename Tree>
+    void Init(Tree&, typename Tree::Node* n){
+        n->set_rank(Next_Priority());
+    }
+
+    // rotate the new leaf up past every parent with a lower priority
+    template <typename Tree>
+    void After_Insert(Tree& t, typename Tree::Node* n){
+        while(active && n->get_parent() != NULL && n->get_parent()->get_rank() < n->get_rank()){
+            if(n->get_parent()->get_left() == n)
+                t.Right_Rotate(n->get_parent());
+            else
+                t.Left_Rotate(n->get_parent());
+        }
+    }
+
+    // rotate the doomed node down, under its higher priority child, until it
+    // has at most one child and can be unlinked without a successor swap
+    template <typename Tree>
+    void Before_Delete(Tree& t, typename Tree::Node* kill){
+        while(active && kill->get_left() != NULL && kill->get_right() != NULL){
+            if(kill->get_left()->get_rank() > kill->get_right()->get_rank())
+                t.Right_Rotate(kill);
+            else
+                t.Left_Rotate(kill);
+        }
+    }
+
+    // A node's children are always a level further down, so giving each
+    // level its own band of priorities, higher bands nearer the root, keeps
+    // the heap order.  The band goes by levels - depth, the tallest the
+    // subtree could be, which needs no stored height.  The bands halve going
+    // up, leaving the bottom level half the range, and each node gets a
+    // random spot in its band
+    template <typename Tree>
+    void After_Build(Tree&, typename Tree::Node* n, int depth, int levels){
+        int h = levels - depth < 31 ? levels - depth : 31; // higher ones all tie at the top
+        uint32_t low = 0x80000000u - (0x80000000u >> (h - 1));
+        uint32_t width = 0x80000000u >> h;
+        n->set_rank((int)(low + (uint32_t)Next_Priority() % width));
+    }
+
+    // no child has a higher priority than its parent, while it's on
+    template <typename Tree>
+    const char* Verify(const Tree& t) const{
+        typedef typename Tree::Node Node;
+        const char* problem = NULL;
+        if(active)
+            t.Walk(t.root, Tree::PREORDER, [&problem](Node* node, int){
+                if(node->get_parent() != NULL && node->get_parent()->get_rank() < node->get_rank())
+                    problem = "a priority is above its parent's";
+            });
+        return problem;
+    }
+
+private:
+    uint32_t state;
+    bool active;
+};
+
+
+// Splay (Sleator and Tarjan): no balance information at all, every insert,
+// delete and Access rotates the node it touched up to the root.  O(log n)
+// amortized, and keys that are asked for often stay a few hops from the root.
+// A const Find leaves it alone, so look up with Access to get any of that
+struct SplayBalance : BalancePolicy{
+    static const char* Name(){ return "splay"; }
+
+    template <typename Tree>
+    void After_Insert(Tree& t, typename Tree::Node* n){
+        Splay(t, n);
+    }
+
+    // bring it to the root first so the unlink happens at the top
+    template <typename Tree>
+    void Before_Delete(Tree& t, typename Tree::Node* kill){
+        Splay(t, kill);
+    }
+
+    // a miss splays the last node looked at, so misses pay for themselves too
+    template <typename Tree>
+    void After_Access(Tree& t, typename Tree::Node* last){
+        if(last != NULL)
+            Splay(t, last);
+    }
+
+    // Splay: zig-zig rotates the grandparent first, zig-zag rotates the
+    // parent first, and a lone zig finishes at the root.  Every node above n
+    // is rotated below it on the way, which recomputes its height from
+    // children that are already right, so the rotations needn't pass heights
+    // further up
+    template <typename Tree>
+    static void Splay(Tree& t, typename Tree::Node* n){
+        typedef typename Tree::Node Node;
+        while(n->get_parent() != NULL){
+            Node* parent = n->get_parent();
+            Node* grand = parent->get_parent();
+            bool left = parent->get_left() == n;
+            if(grand == NULL){ // zig
+                if(left)
+                    t.Right_Rotate(parent, false);
+                else
+                    t.Left_Rotate(parent, false);
+            }
+            else if(left == (grand->get_left() == parent)){ // zig-zig
+                if(left){
+                    t.Right_Rotate(grand, false);
+                    t.Right_Rotate(parent, false);
+                }
+                else{
+                    t.Left_Rotate(grand, false);
+                    t.Left_Rotate(parent, false);
+                }
+            }
+            else{ // zig-zag
+                if(left){
+                    t.Right_Rotate(parent, false);
+                    t.Left_Rotate(grand, false);
+                }
+                else{
+                    t.Left_Rotate(parent, false);
+                    t.Right_Rotate(grand, false);
+                }
+            }
+        }
+    }
+};
+
+
+template <typename T>
+using UnbalancedTree = BalancedTree<T, NoBalance>;
+
+template <typename T>
+using RBTree = BalancedTree<T, RedBlackBalance>;
+
+template <typename T>
+using AVLTree = BalancedTree<T, AVLBalance>;
+
+template <typename T>
+using WAVLTree = BalancedTree<T, WAVLBalance>;
+
+template <typename T>
+using TreapTree = BalancedTree<T, TreapBalance>;
+
+template <typename T>
+using SplayTree = BalancedTree<T, SplayBalance>;
+
+#endif
@@ -0,0 +1,151 @@
+//
+//  bloomfilter.h
+//  RedBlackTree
+//
+//  A blocked Bloom filter: says "maybe" for every key added to it and "no"
+//  for most others.  Each key sets eight bits, one in each 64-bit word of a
+//  single 64 byte block, so asking about a key touches one cache line where
+//  a plain Bloom filter would touch eight.  That costs a little in false
+//  positives for the same memory, about 1% at 10 bits a key.
+//
+//  Nothing can be taken out; whoever keeps one in front of a set that
+//  shrinks has to rebuild it now and then, as BalancedTree::Set_Filter does.
+//
+
+#ifndef BLOOMFILTER_H
+#define BLOOMFILTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+using namespace std;
+
+// whether std::hash<T> works, so a filter can be offered only where it does
+template <typename T, typename = void>
+struct Is_Hashable : false_type{};
+
+template <typename T>
+struct Is_Hashable<T, decltype((void)hash<T>()(declval<const T&>()))> : true_type{};
+
+template <typename T>
+class BlockedBloomFilter{
+public:
+    BlockedBloomFilter();
+
+    // empties the filter and sizes it for "items" keys at "bitsPerItem"
+    // bits each
+    void Reset(size_t items, int bitsPerItem);
+
+    void Add(const T& x);
+
+    // false means x was never added; true means it probably was
+    bool May_Contain(const T& x) const;
+
+    // the number of keys it was sized for
+    size_t Capacity() const;
+
+    size_t Bytes() const;
+
+private:
+    struct alignas(64) Block{
+        uint64_t words[8];
+    };
+
+    vector<Block> blocks;
+    size_t capacity;
+
+    // std::hash is the identity for integers, which would put neighbouring
+    // keys in neighbouring blocks with the same bits set
+    static uint64_t Mix(uint64_t h);
+
+    // the block x's bits are in, and the bits, one a word
+    size_t Block_For(uint64_t h) const;
+    static void Bits_For(uint64_t h, uint64_t bits[8]);
+};
+
+
+template <typename T>
+BlockedBloomFilter<T>::BlockedBloomFilter(){
+    capacity = 0;
+    Reset(0, 10);
+}
+
+template <typename T>
+void BlockedBloomFilter<T>::Reset(size_t items, int bitsPerItem){
+    if(bitsPerItem < 1)
+        bitsPerItem = 1;
+    size_t count = (items * bitsPerItem + 511) / 512;
+    if(count == 0)
+        count = 1;
+    Block empty = {};
+    blocks.assign(count, empty);
+    capacity = items;
+}
+
+template <typename T>
+void BlockedBloomFilter<T>::Add(const T& x){
+    uint64_t h = Mix(hash<T>()(x));
+    uint64_t bits[8];
+    Bits_For(h, bits);
+    Block& block = blocks[Block_For(h)];
+    for(int i = 0; i < 8; i++)
+        block.words[i] |= bits[i];
+}
+
+// May_Contain: the block's eight words are all loaded and checked without
+// an early exit, which compiles to a few vector ops and no branches
+template <typename T>
+bool BlockedBloomFilter<T>::May_Contain(const T& x) const{
+    uint64_t h = Mix(hash<T>()(x));
+    uint64_t bits[8];
+    Bits_For(h, bits);
+    const Block& block = blocks[Block_For(h)];
+    uint64_t missing = 0;
+    for(int i = 0; i < 8; i++)
+        missing |= bits[i] & ~block.words[i];
+    return missing == 0;
+}
+
+template <typename T>
+size_t BlockedBloomFilter<T>::Capacity() const{
+    return capacity;
+}
+
+template <typename T>
+size_t BlockedBloomFilter<T>::Bytes() const{
+    return blocks.size() * sizeof(Block);
+}
+
+// Mix: the murmur3 finalizer
+template <typename T>
+uint64_t BlockedBloomFilter<T>::Mix(uint64_t h){
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// Block_For: the high half picks the block by multiplying rather than by
+// taking a remainder, so the count needn't be a power of two
+template <typename T>
+size_t BlockedBloomFilter<T>::Block_For(uint64_t h) const{
+    return (size_t)(((h >> 32) * (uint64_t)blocks.size()) >> 32);
+}
+
+// Bits_For: the low half times eight odd constants, the top six bits of
+// each product picking the bit in its word
+template <typename T>
+void BlockedBloomFilter<T>::Bits_For(uint64_t h, uint64_t bits[8]){
+    static const uint32_t SALT[8] = { 0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+                                      0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U };
+    uint32_t low = (uint32_t)h;
+    for(int i = 0; i < 8; i++)
+        bits[i] = (uint64_t)1 << ((uint32_t)(low * SALT[i]) >> 26);
+}
+
+#endif
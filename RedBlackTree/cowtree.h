@@ -0,0 +1,150 @@
+//
+//  cowtree.h
+//  RedBlackTree
+//
+//  A copy-on-write handle on a RedBlackTree.  Copies share one tree through
+//  a reference count, so passing a handle by value costs O(1); the first
+//  change made through a handle whose tree is shared clones the tree for it
+//  alone.  Copies that are only ever read never pay for the O(n) deep copy.
+//
+//  Like RedBlackTree itself a handle isn't thread safe, and neither is
+//  handing copies of one to other threads without a lock around them.
+//
+
+#ifndef CowRedBlackTree_H
+#define CowRedBlackTree_H
+
+#include "redblacktree.h"
+#include <memory>
+#include <vector>
+#include <string>
+using namespace std;
+
+template <typename T>
+class CowRedBlackTree{
+public:
+    // an empty tree of its own
+    CowRedBlackTree();
+
+    // takes a copy of "tree" to share from now on
+    explicit CowRedBlackTree(const RedBlackTree<T>& tree);
+
+    // copying a handle and assigning one just share the tree, the defaults
+    // do exactly that
+
+    // the same operations as RedBlackTree.  The writes clone a shared tree
+    // first, unless they turn out not to change anything
+    void Red_Black_Insert(const T& x);
+
+    void Red_Black_Insert_Hinted(const T& x);
+
+    bool Red_Black_Delete(const T& x);
+
+    bool Find(const T& x) const;
+
+    int Height() const;
+
+    int Black_Height() const;
+
+    void Dump_To_Vector(vector<T>& V) const;
+
+    string Path_To_Item(const T& x) const;
+
+    void Print_Inorder() const;
+
+    void Print_Treeorder() const;
+
+    // read-only access to the whole tree, for everything not forwarded above
+    const RedBlackTree<T>& Read() const;
+
+    // write access, cloning the tree first if another handle shares it.  The
+    // reference is only good until this handle is next copied
+    RedBlackTree<T>& Write();
+
+    // true when another handle is looking at the same tree
+    bool Is_Shared() const;
+
+private:
+    shared_ptr<RedBlackTree<T> > tree;
+};
+
+
+template <typename T>
+CowRedBlackTree<T>::CowRedBlackTree() : tree(make_shared<RedBlackTree<T> >()){}
+
+template <typename T>
+CowRedBlackTree<T>::CowRedBlackTree(const RedBlackTree<T>& other)
+: tree(make_shared<RedBlackTree<T> >(other)){}
+
+template <typename T>
+void CowRedBlackTree<T>::Red_Black_Insert(const T& x){
+    Write().Red_Black_Insert(x);
+}
+
+template <typename T>
+void CowRedBlackTree<T>::Red_Black_Insert_Hinted(const T& x){
+    Write().Red_Black_Insert_Hinted(x);
+}
+
+// Red_Black_Delete: deleting something that isn't there changes nothing, and
+// finding that out is a lot cheaper than a clone
+template <typename T>
+bool CowRedBlackTree<T>::Red_Black_Delete(const T& x){
+    if(Is_Shared() && !tree->Find(x))
+        return false;
+    return Write().Red_Black_Delete(x);
+}
+
+template <typename T>
+bool CowRedBlackTree<T>::Find(const T& x) const{
+    return tree->Find(x);
+}
+
+template <typename T>
+int CowRedBlackTree<T>::Height() const{
+    return tree->Height();
+}
+
+template <typename T>
+int CowRedBlackTree<T>::Black_Height() const{
+    return tree->Black_Height();
+}
+
+template <typename T>
+void CowRedBlackTree<T>::Dump_To_Vector(vector<T>& v) const{
+    tree->Dump_To_Vector(v);
+}
+
+template <typename T>
+string CowRedBlackTree<T>::Path_To_Item(const T& x) const{
+    return tree->Path_To_Item(x);
+}
+
+template <typename T>
+void CowRedBlackTree<T>::Print_Inorder() const{
+    tree->Print_Inorder();
+}
+
+template <typename T>
+void CowRedBlackTree<T>::Print_Treeorder() const{
+    tree->Print_Treeorder();
+}
+
+template <typename T>
+const RedBlackTree<T>& CowRedBlackTree<T>::Read() const{
+    return *tree;
+}
+
+template <typename T>
+RedBlackTree<T>& CowRedBlackTree<T>::Write(){
+    if(Is_Shared())
+        tree = make_shared<RedBlackTree<T> >(*tree);
+    return *tree;
+}
+
+template <typename T>
+bool CowRedBlackTree<T>::Is_Shared() const{
+    return tree.use_count() > 1;
+}
+
+#endif
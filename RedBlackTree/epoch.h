@@ -0,0 +1,269 @@
+//
+//  epoch.h
+//  RedBlackTree
+//
+//  Epoch based memory reclamation for the lock-free containers.  A thread
+//  holds an EpochGuard while it may be looking at shared nodes; a node that
+//  has been unlinked is handed to Retire instead of being deleted, and is
+//  freed once every thread that could still have seen it has left its
+//  guard.
+//
+//  The global epoch only moves from e to e + 1 once every pinned thread has
+//  seen e, so a node retired during e can't be reachable by anyone once the
+//  epoch reaches e + 2.  Each thread keeps three bags of retired nodes, one
+//  per epoch modulo 3, and empties the bag for e when it next pins in e + 3.
+//  A thread that exits leaves its bags on the domain's orphan list, where
+//  Try_Advance frees them once the epoch is two past the last one it saw.
+//
+
+#ifndef Epoch_H
+#define Epoch_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+class EpochDomain{
+public:
+    // the one domain every lock-free container shares
+    static EpochDomain& Global();
+
+    ~EpochDomain();
+
+    // pins the calling thread in the current epoch.  Pins nest
+    void Pin();
+
+    void Unpin();
+
+    // frees p with "release" once no pinned thread can still see it.  The
+    // caller must be pinned and p must already be unreachable for new readers
+    void Retire(void* p, void (*release)(void*));
+
+    // frees everything retired so far, orphaned or not, at once.  Only for
+    // when no thread is pinned or retiring, e.g. between tests
+    void Drain();
+
+private:
+    struct Retired{
+        void* p;
+        void (*release)(void*);
+    };
+
+    // one per thread that has ever pinned, reused after the thread exits
+    struct Record{
+        atomic<uint64_t> state; // epoch << 1, low bit set while pinned
+        atomic<bool> inUse;
+        int depth;              // nesting of Pin calls
+        uint64_t seen;          // epoch of the current or last pin
+        unsigned retiredSinceScan;
+        vector<Retired> bags[3];
+        Record* next;
+    };
+
+    // the bags of a thread that exited, none of it retired after "epoch"
+    struct Orphan{
+        uint64_t epoch;
+        vector<Retired> items;
+        Orphan* next;
+    };
+
+    // gives the record back when its thread exits
+    struct Owner{
+        Record* record;
+        Owner();
+        ~Owner();
+    };
+
+    static const unsigned SCAN_EVERY = 64;
+
+    atomic<uint64_t> global;
+    atomic<Record*> records;
+    atomic<Orphan*> orphans;
+
+    EpochDomain();
+    EpochDomain(const EpochDomain&) = delete;
+    EpochDomain& operator=(const EpochDomain&) = delete;
+
+    Record* Mine();
+    Record* Acquire_Record();
+
+    // moves the global epoch on if every pinned thread has seen it, and
+    // frees the orphans that makes safe
+    void Try_Advance();
+
+    void Push_Orphan(Orphan* o);
+
+    static void Free_Bag(vector<Retired>& bag);
+};
+
+// pins the current thread for as long as it's in scope
+class EpochGuard{
+public:
+    EpochGuard(){ EpochDomain::Global().Pin(); }
+    ~EpochGuard(){ EpochDomain::Global().Unpin(); }
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+};
+
+
+inline EpochDomain& EpochDomain::Global(){
+    static EpochDomain domain;
+    return domain;
+}
+
+inline EpochDomain::EpochDomain() : global(0), records(NULL), orphans(NULL){}
+
+// only runs at exit, when no thread is pinned any more
+inline EpochDomain::~EpochDomain(){
+    Record* r = records.load(memory_order_acquire);
+    while(r != NULL){
+        Record* next = r->next;
+        for(int b = 0; b < 3; b++)
+            Free_Bag(r->bags[b]);
+        delete r;
+        r = next;
+    }
+    for(Orphan* o = orphans.load(memory_order_acquire); o != NULL; ){
+        Orphan* next = o->next;
+        Free_Bag(o->items);
+        delete o;
+        o = next;
+    }
+}
+
+inline EpochDomain::Owner::Owner(){
+    record = Global().Acquire_Record();
+}
+
+// ~Owner: the bags go on the orphan list, or nobody would free them until
+// another thread happened to take over the record
+inline EpochDomain::Owner::~Owner(){
+    Orphan* o = NULL;
+    for(int b = 0; b < 3; b++){
+        if(record->bags[b].empty())
+            continue;
+        if(o == NULL){
+            o = new Orphan;
+            o->epoch = record->seen;
+        }
+        o->items.insert(o->items.end(), record->bags[b].begin(), record->bags[b].end());
+        record->bags[b].clear();
+    }
+    if(o != NULL)
+        Global().Push_Orphan(o);
+    record->inUse.store(false, memory_order_release);
+}
+
+inline EpochDomain::Record* EpochDomain::Mine(){
+    static thread_local Owner owner;
+    return owner.record;
+}
+
+// Acquire_Record: take over one a finished thread left behind, or push a new
+// one.  Records are never unlinked, so walking the list needs no protection
+inline EpochDomain::Record* EpochDomain::Acquire_Record(){
+    for(Record* r = records.load(memory_order_acquire); r != NULL; r = r->next){
+        bool expected = false;
+        if(!r->inUse.load(memory_order_relaxed)
+           && r->inUse.compare_exchange_strong(expected, true, memory_order_acquire))
+            return r;
+    }
+    Record* r = new Record;
+    r->state.store(0, memory_order_relaxed);
+    r->inUse.store(true, memory_order_relaxed);
+    r->depth = 0;
+    r->seen = 0;
+    r->retiredSinceScan = 0;
+    r->next = records.load(memory_order_relaxed);
+    while(!records.compare_exchange_weak(r->next, r, memory_order_release, memory_order_relaxed))
+        ;
+    return r;
+}
+
+// Pin: announcing the epoch and then reading shared pointers must not be
+// reordered, which the seq_cst store makes sure of against Try_Advance's
+// seq_cst loads
+inline void EpochDomain::Pin(){
+    Record* r = Mine();
+    if(r->depth++ > 0)
+        return;
+    uint64_t e = global.load(memory_order_seq_cst);
+    r->state.store(e << 1 | 1, memory_order_seq_cst);
+    if(e != r->seen){ // this bag was filled at least three epochs ago
+        Free_Bag(r->bags[e % 3]);
+        r->seen = e;
+    }
+}
+
+inline void EpochDomain::Unpin(){
+    Record* r = Mine();
+    if(--r->depth == 0)
+        r->state.store(r->seen << 1, memory_order_release);
+}
+
+inline void EpochDomain::Retire(void* p, void (*release)(void*)){
+    Record* r = Mine();
+    Retired item = {p, release};
+    r->bags[r->seen % 3].push_back(item);
+    if(++r->retiredSinceScan >= SCAN_EVERY){
+        r->retiredSinceScan = 0;
+        Try_Advance();
+    }
+}
+
+// Try_Advance: the orphans are taken off the list all at once, so two
+// threads at it never see the same one; the ones that aren't safe yet go
+// back on
+inline void EpochDomain::Try_Advance(){
+    uint64_t e = global.load(memory_order_seq_cst);
+    for(Record* r = records.load(memory_order_acquire); r != NULL; r = r->next){
+        uint64_t s = r->state.load(memory_order_seq_cst);
+        if((s & 1) != 0 && (s >> 1) != e) // pinned in an older epoch
+            return;
+    }
+    global.compare_exchange_strong(e, e + 1, memory_order_seq_cst);
+    if(orphans.load(memory_order_relaxed) == NULL)
+        return;
+    uint64_t now = global.load(memory_order_seq_cst);
+    Orphan* o = orphans.exchange(NULL, memory_order_acquire);
+    while(o != NULL){
+        Orphan* next = o->next;
+        if(o->epoch + 2 <= now){
+            Free_Bag(o->items);
+            delete o;
+        }
+        else
+            Push_Orphan(o);
+        o = next;
+    }
+}
+
+inline void EpochDomain::Push_Orphan(Orphan* o){
+    o->next = orphans.load(memory_order_relaxed);
+    while(!orphans.compare_exchange_weak(o->next, o, memory_order_release, memory_order_relaxed))
+        ;
+}
+
+inline void EpochDomain::Drain(){
+    for(Record* r = records.load(memory_order_acquire); r != NULL; r = r->next){
+        for(int b = 0; b < 3; b++)
+            Free_Bag(r->bags[b]);
+    }
+    Orphan* o = orphans.exchange(NULL, memory_order_acquire);
+    while(o != NULL){
+        Orphan* next = o->next;
+        Free_Bag(o->items);
+        delete o;
+        o = next;
+    }
+}
+
+inline void EpochDomain::Free_Bag(vector<Retired>& bag){
+    for(size_t i = 0; i < bag.size(); i++)
+        bag[i].release(bag[i].p);
+    bag.clear();
+}
+
+#endif
@@ -0,0 +1,614 @@
+//
+//  indexedtree.h
+//  RedBlackTree
+//
+//  A red-black tree whose nodes all live in one vector and link to each
+//  other by 32-bit index instead of by pointer.  The color rides in the top
+//  bit of the parent index, so an int node is 16 bytes against
+//  BalancedTreeNode's 40, the nodes sit next to each other in memory, and
+//  the whole tree can be copied or moved as one block: no link points
+//  outside the vector.  Subtree heights are a byte a node in a second vector
+//  alongside, which keeps Height() O(1) without widening the nodes, and is
+//  small enough that reading a sibling's height is rarely a cache miss.
+//
+//  Slot 0 is the NIL sentinel of CLRS, a black node every missing child
+//  points at, which lets the delete fixup work on "x" even when it's
+//  missing.  Deleted slots go on a free list threaded through their left
+//  links and are reused before the vector grows.
+//
+
+#ifndef IndexedRedBlackTree_H
+#define IndexedRedBlackTree_H
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+using namespace std;
+
+template <typename T>
+class IndexedRedBlackTree{
+public:
+    // an empty tree, just the sentinel
+    IndexedRedBlackTree();
+
+    // copying and assigning copy the vectors, the defaults do exactly that
+
+    // Insert item x into the correct position in the tree and fix the tree
+    void Red_Black_Insert(const T& x);
+
+    // delets (a copy of) item x.  Returns true if it's found, False otherwise
+    bool Red_Black_Delete(const T& x);
+
+    // Determines whether item x is in the tree
+    bool Find(const T& x) const;
+
+    // returns the height of the longest branch, in nodes
+    int Height() const;
+
+    // black nodes on every path from the root down to a leaf
+    int Black_Height() const;
+
+    // dumps all items into a sorted vector
+    void Dump_To_Vector(vector<T>& V) const;
+
+    // Calls visit(item) for every item in sorted order
+    template <typename Visitor>
+    void Visit_In_Order(Visitor visit) const;
+
+    void Print_Inorder() const;
+
+    // number of items
+    long Size() const;
+
+    // bytes the node and height vectors have allocated
+    size_t Bytes() const;
+
+    // makes room for n items without growing the vector again
+    void Reserve(size_t n);
+
+    // checks the order, the parent links, the colors and the stored heights,
+    // and says on cerr what's wrong if anything is.  O(n), for tests
+    bool Verify() const;
+
+private:
+    typedef uint32_t Index;
+
+    static const Index NIL = 0;
+    static const Index BLACK = 0x80000000u; // in parentColor; the rest is the parent
+
+    struct Node{
+        T item;
+        Index left;
+        Index right;
+        Index parentColor;
+    };
+
+    vector<Node> nodes;
+    // heights[n] is the height of the subtree at n, a lone node being 1 and
+    // NIL 0.  A red-black tree with under 2^31 nodes is at most 62 tall
+    vector<uint8_t> heights;
+    Index root;
+    Index freeList; // first free slot, NIL if none
+    long count;
+
+    Index Parent(Index n) const;
+    void Set_Parent(Index n, Index p);
+    bool Is_Black(Index n) const;
+    void Set_Black(Index n, bool black);
+
+    // recomputes n's height from its children
+    void Update_Height(Index n);
+
+    // recomputes heights from n up towards the root, stopping as soon as one
+    // doesn't change
+    void Update_Heights_Upward(Index n);
+
+    // a red node holding x with NIL children, from the free list if it can
+    Index New_Node(const T& x);
+
+    void Free_Node(Index n);
+
+    // Fixes the tree after inserting z
+    void Insert_Fixup(Index z);
+
+    // fixes the tree after deleting a black node, x being what took its place
+    void Delete_Fixup(Index x);
+
+    void Left_Rotate(Index x);
+
+    void Right_Rotate(Index x);
+
+    // after a rotation has put y where x was: x still has the old height of
+    // the whole subtree, so only if y's comes out different does it go on up
+    void Fix_Rotated_Heights(Index x, Index y);
+
+    // Replaces the subtree rooted at u with the one rooted at v (maybe NIL)
+    void Transplant(Index u, Index v);
+
+    // the node holding x, NIL if there's none
+    Index Find_Node(const T& x) const;
+
+    Index Minimum(Index n) const;
+};
+
+
+template <typename T>
+IndexedRedBlackTree<T>::IndexedRedBlackTree(){
+    Node nil;
+    nil.item = T();
+    nil.left = NIL;
+    nil.right = NIL;
+    nil.parentColor = BLACK | NIL;
+    nodes.push_back(nil);
+    heights.push_back(0);
+    root = NIL;
+    freeList = NIL;
+    count = 0;
+}
+
+template <typename T>
+typename IndexedRedBlackTree<T>::Index IndexedRedBlackTree<T>::Parent(Index n) const{
+    return nodes[n].parentColor & ~BLACK;
+}
+
+template <typename T>
+void IndexedRedBlackTree<T>::Set_Parent(Index n, Index p){
+    nodes[n].parentColor = (nodes[n].parentColor & BLACK) | p;
+}
+
+template <typename T>
+bool IndexedRedBlackTree<T>::Is_Black(Index n) const{
+    return (nodes[n].parentColor & BLACK) != 0;
+}
+
+template <typename T>
+void IndexedRedBlackTree<T>::Set_Black(Index n, bool black){
+    if(black)
+        nodes[n].parentColor |= BLACK;
+    else
+        nodes[n].parentColor &= ~BLACK;
+}
+
+// Update_Height: NIL's height is 0, which is what makes this work without
+// checking for missing children
+template <typename T>
+void IndexedRedBlackTree<T>::Update_Height(Index n){
+    uint8_t left = heights[nodes[n].left];
+    uint8_t right = heights[nodes[n].right];
+    heights[n] = 1 + (left > right ? left : right);
+}
+
+template <typename T>
+void IndexedRedBlackTree<T>::Update_Heights_Upward(Index n){
+    while(n != NIL){
+        uint8_t before = heights[n];
+        Update_Height(n);
+        if(heights[n] == before)
+            return;
+        n = Parent(n);
+    }
+}
+
+// Red_Black_Insert: equal items go left, like RedBlackTree.  The descent
+// happens before New_Node, which may move every node
+template <typename T>
+void IndexedRedBlackTree<T>::Red_Black_Insert(const T& x){
+    Index parent = NIL;
+    Index cur = root;
+    bool left = false;
+    while(cur != NIL){
+        parent = cur;
+        left = nodes[cur].item >= x;
+        cur = left ? nodes[cur].left : nodes[cur].right;
+    }
+    Index z = New_Node(x);
+    Set_Parent(z, parent);
+    if(parent == NIL)
+        root = z;
+    else if(left)
+        nodes[parent].left = z;
+    else
+        nodes[parent].right = z;
+    count++;
+    // heights only grow here, so each one up is one more than the one below
+    // unless it's already that tall, and the siblings needn't be looked at
+    uint8_t height = 1;
+    for(Index p = parent; p != NIL && heights[p] <= height; p = Parent(p))
+        heights[p] = ++height;
+    Insert_Fixup(z);
+}
+
+// Red_Black_Delete: CLRS's RB-DELETE.  y is the node that really leaves its
+// spot, z itself or its successor, and x is what moves into that spot.
+// When y moves up it takes z's height along with z's spot, which leaves the
+// path up from x's new parent as the only heights that can be wrong; they're
+// fixed before the fixup rotates anything
+template <typename T>
+bool IndexedRedBlackTree<T>::Red_Black_Delete(const T& item){
+    Index z = Find_Node(item);
+    if(z == NIL)
+        return false;
+    Index y = z;
+    bool yWasBlack = Is_Black(y);
+    Index x;
+    if(nodes[z].left == NIL){
+        x = nodes[z].right;
+        Transplant(z, x);
+    }
+    else if(nodes[z].right == NIL){
+        x = nodes[z].left;
+        Transplant(z, x);
+    }
+    else{
+        y = Minimum(nodes[z].right);
+        yWasBlack = Is_Black(y);
+        x = nodes[y].right;
+        if(Parent(y) == z)
+            Set_Parent(x, y); // x may be NIL, the fixup needs its parent
+        else{
+            Transplant(y, nodes[y].right);
+            nodes[y].right = nodes[z].right;
+            Set_Parent(nodes[y].right, y);
+        }
+        Transplant(z, y);
+        nodes[y].left = nodes[z].left;
+        Set_Parent(nodes[y].left, y);
+        Set_Black(y, Is_Black(z));
+        heights[y] = heights[z];
+    }
+    Update_Heights_Upward(Parent(x));
+    if(yWasBlack)
+        Delete_Fixup(x);
+    Free_Node(z);
+    count--;
+    return true;
+}
+
+template <typename T>
+bool IndexedRedBlackTree<T>::Find(const T& x) const{
+    return Find_Node(x) != NIL;
+}
+
+template <typename T>
+int IndexedRedBlackTree<T>::Height() const{
+    return heights[root];
+}
+
+template <typename T>
+int IndexedRedBlackTree<T>::Black_Height() const{
+    int blacks = 0;
+    for(Index n = root; n != NIL; n = nodes[n].left)
+        if(Is_Black(n))
+            blacks++;
+    return blacks;
+}
+
+template <typename T>
+void IndexedRedBlackTree<T>::Dump_To_Vector(vector<T>& v) const{
+    v.reserve(v.size() + count);
+    Visit_In_Order([&v](const T& item){
+        v.push_back(item);
+    });
+}
+
+// Visit_In_Order: the successor walk, up through the parents when there's
+// no right subtree
+template <typename T>
+template <typename Visitor>
+void IndexedRedBlackTree<T>::Visit_In_Order(Visitor visit) const{
+    if(root == NIL)
+        return;
+    Index n = Minimum(root);
+    while(n != NIL){
+        visit(nodes[n].item);
+        if(nodes[n].right != NIL)
+            n = Minimum(nodes[n].right);
+        else{
+            Index p = Parent(n);
+            while(p != NIL && n == nodes[p].right){
+                n = p;
+                p = Parent(p);
+            }
+            n = p;
+        }
+    }
+}
+
+template <typename T>
+void IndexedRedBlackTree<T>::Print_Inorder() const{
+    Visit_In_Order([](const T& item){
+        cout << item << " ";
+    });
+}
+
+template <typename T>
+long IndexedRedBlackTree<T>::Size() const{
+    return count;
+}
+
+template <typename T>
+size_t IndexedRedBlackTree<T>::Bytes() const{
+    return nodes.capacity() * sizeof(Node) + heights.capacity();
+}
+
+template <typename T>
+void IndexedRedBlackTree<T>::Reserve(size_t n){
+    nodes.reserve(n + 1);
+    heights.reserve(n + 1);
+}
+
+// Verify: one pass down with an explicit stack, each node carrying the
+// bounds its items must fall between and the blacks counted above it
+template <typename T>
+bool IndexedRedBlackTree<T>::Verify() const{
+    struct Frame{
+        Index n;
+        Index low;  // every item here is >= low's, NIL for no bound
+        Index high; // and <= high's
+        int blacks; // above n
+    };
+    const char* problem = NULL;
+    long seen = 0;
+    int leafBlacks = -1;
+    if(!Is_Black(root))
+        problem = "the root is red";
+    else if(Parent(root) != NIL)
+        problem = "the root has a parent";
+    else if(heights[NIL] != 0)
+        problem = "NIL has a height";
+    vector<Frame> stack;
+    if(root != NIL){
+        Frame top = { root, NIL, NIL, 0 };
+        stack.push_back(top);
+    }
+    while(problem == NULL && !stack.empty()){
+        Frame f = stack.back();
+        stack.pop_back();
+        const Node& node = nodes[f.n];
+        seen++;
+        int blacks = f.blacks + Is_Black(f.n);
+        if((f.low != NIL && node.item < nodes[f.low].item)
+           || (f.high != NIL && nodes[f.high].item < node.item))
+            problem = "an item is out of order";
+        else if(!Is_Black(f.n) && !Is_Black(Parent(f.n)))
+            problem = "a red node has a red parent";
+        else if(heights[f.n] != 1 + max(heights[node.left], heights[node.right]))
+            problem = "a stored height is wrong";
+        Index children[2] = { node.left, node.right };
+        for(int side = 0; side < 2 && problem == NULL; side++){
+            if(children[side] == NIL){
+                if(leafBlacks == -1)
+                    leafBlacks = blacks;
+                else if(leafBlacks != blacks)
+                    problem = "two paths have different black heights";
+                continue;
+            }
+            if(Parent(children[side]) != f.n)
+                problem = "a child's parent link doesn't point back";
+            Frame below = { children[side], side == 0 ? f.low : f.n, side == 0 ? f.n : f.high, blacks };
+            stack.push_back(below);
+        }
+    }
+    if(problem == NULL && seen != count)
+        problem = "the node count is wrong";
+    if(problem != NULL)
+        cerr << "IndexedRedBlackTree::Verify: " << problem << endl;
+    return problem == NULL;
+}
+
+template <typename T>
+typename IndexedRedBlackTree<T>::Index IndexedRedBlackTree<T>::New_Node(const T& x){
+    Index n;
+    if(freeList != NIL){
+        n = freeList;
+        freeList = nodes[n].left;
+    }
+    else{
+        if(nodes.size() >= BLACK) // the next index would hit the color bit
+            throw length_error("IndexedRedBlackTree: too many nodes");
+        n = (Index)nodes.size();
+        nodes.push_back(Node());
+        heights.push_back(0);
+    }
+    nodes[n].item = x;
+    nodes[n].left = NIL;
+    nodes[n].right = NIL;
+    nodes[n].parentColor = NIL; // red
+    heights[n] = 1;
+    return n;
+}
+
+template <typename T>
+void IndexedRedBlackTree<T>::Free_Node(Index n){
+    nodes[n].item = T(); // let go of anything the item holds
+    nodes[n].left = freeList;
+    freeList = n;
+}
+
+template <typename T>
+void IndexedRedBlackTree<T>::Insert_Fixup(Index z){
+    while(!Is_Black(Parent(z))){ // the root's parent is the black NIL
+        Index p = Parent(z);
+        Index g = Parent(p);
+        if(p == nodes[g].left){
+            Index uncle = nodes[g].right;
+            if(!Is_Black(uncle)){ // recolor and go on from the grandparent
+                Set_Black(p, true);
+                Set_Black(uncle, true);
+                Set_Black(g, false);
+                z = g;
+            }
+            else{
+                if(z == nodes[p].right){ // make it a left-left case
+                    z = p;
+                    Left_Rotate(z);
+                    p = Parent(z);
+                }
+                Set_Black(p, true);
+                Set_Black(g, false);
+                Right_Rotate(g);
+            }
+        }
+        else{
+            Index uncle = nodes[g].left;
+            if(!Is_Black(uncle)){
+                Set_Black(p, true);
+                Set_Black(uncle, true);
+                Set_Black(g, false);
+                z = g;
+            }
+            else{
+                if(z == nodes[p].left){
+                    z = p;
+                    Right_Rotate(z);
+                    p = Parent(z);
+                }
+                Set_Black(p, true);
+                Set_Black(g, false);
+                Left_Rotate(g);
+            }
+        }
+    }
+    Set_Black(root, true);
+}
+
+template <typename T>
+void IndexedRedBlackTree<T>::Delete_Fixup(Index x){
+    while(x != root && Is_Black(x)){
+        Index p = Parent(x);
+        if(x == nodes[p].left){
+            Index sibling = nodes[p].right;
+            if(!Is_Black(sibling)){
+                Set_Black(sibling, true);
+                Set_Black(p, false);
+                Left_Rotate(p);
+                sibling = nodes[p].right;
+            }
+            if(Is_Black(nodes[sibling].left) && Is_Black(nodes[sibling].right)){
+                Set_Black(sibling, false);
+                x = p;
+            }
+            else{
+                if(Is_Black(nodes[sibling].right)){
+                    Set_Black(nodes[sibling].left, true);
+                    Set_Black(sibling, false);
+                    Right_Rotate(sibling);
+                    sibling = nodes[p].right;
+                }
+                Set_Black(sibling, Is_Black(p));
+                Set_Black(p, true);
+                Set_Black(nodes[sibling].right, true);
+                Left_Rotate(p);
+                x = root;
+            }
+        }
+        else{
+            Index sibling = nodes[p].left;
+            if(!Is_Black(sibling)){
+                Set_Black(sibling, true);
+                Set_Black(p, false);
+                Right_Rotate(p);
+                sibling = nodes[p].left;
+            }
+            if(Is_Black(nodes[sibling].left) && Is_Black(nodes[sibling].right)){
+                Set_Black(sibling, false);
+                x = p;
+            }
+            else{
+                if(Is_Black(nodes[sibling].left)){
+                    Set_Black(nodes[sibling].right, true);
+                    Set_Black(sibling, false);
+                    Left_Rotate(sibling);
+                    sibling = nodes[p].left;
+                }
+                Set_Black(sibling, Is_Black(p));
+                Set_Black(p, true);
+                Set_Black(nodes[sibling].left, true);
+                Right_Rotate(p);
+                x = root;
+            }
+        }
+    }
+    Set_Black(x, true);
+}
+
+template <typename T>
+void IndexedRedBlackTree<T>::Left_Rotate(Index x){
+    Index y = nodes[x].right;
+    Index p = Parent(x);
+    nodes[x].right = nodes[y].left;
+    if(nodes[y].left != NIL)
+        Set_Parent(nodes[y].left, x);
+    Set_Parent(y, p);
+    if(p == NIL)
+        root = y;
+    else if(x == nodes[p].left)
+        nodes[p].left = y;
+    else
+        nodes[p].right = y;
+    nodes[y].left = x;
+    Set_Parent(x, y);
+    Fix_Rotated_Heights(x, y);
+}
+
+template <typename T>
+void IndexedRedBlackTree<T>::Right_Rotate(Index x){
+    Index y = nodes[x].left;
+    Index p = Parent(x);
+    nodes[x].left = nodes[y].right;
+    if(nodes[y].right != NIL)
+        Set_Parent(nodes[y].right, x);
+    Set_Parent(y, p);
+    if(p == NIL)
+        root = y;
+    else if(x == nodes[p].right)
+        nodes[p].right = y;
+    else
+        nodes[p].left = y;
+    nodes[y].right = x;
+    Set_Parent(x, y);
+    Fix_Rotated_Heights(x, y);
+}
+
+template <typename T>
+void IndexedRedBlackTree<T>::Fix_Rotated_Heights(Index x, Index y){
+    uint8_t before = heights[x];
+    Update_Height(x);
+    Update_Height(y);
+    if(heights[y] != before)
+        Update_Heights_Upward(Parent(y));
+}
+
+template <typename T>
+void IndexedRedBlackTree<T>::Transplant(Index u, Index v){
+    Index p = Parent(u);
+    if(p == NIL)
+        root = v;
+    else if(u == nodes[p].left)
+        nodes[p].left = v;
+    else
+        nodes[p].right = v;
+    Set_Parent(v, p);
+}
+
+template <typename T>
+typename IndexedRedBlackTree<T>::Index IndexedRedBlackTree<T>::Find_Node(const T& x) const{
+    Index cur = root;
+    while(cur != NIL){
+        if(nodes[cur].item == x)
+            return cur;
+        cur = nodes[cur].item < x ? nodes[cur].right : nodes[cur].left;
+    }
+    return NIL;
+}
+
+template <typename T>
+typename IndexedRedBlackTree<T>::Index IndexedRedBlackTree<T>::Minimum(Index n) const{
+    while(nodes[n].left != NIL)
+        n = nodes[n].left;
+    return n;
+}
+
+#endif
@@ -0,0 +1,300 @@
+//
+//  lockfreeset.h
+//  RedBlackTree
+//
+//  A lock-free ordered set: a skiplist whose links are CAS'd, after Herlihy
+//  and Shavit's LockFreeSkipList, with unlinked nodes handed to the epoch
+//  reclaimer in epoch.h.  It has RedBlackTree's method names so either can
+//  sit behind the same code, but it is a set: inserting an item that's
+//  already there does nothing.
+//
+//  A node is deleted by marking the low bit of each of its next pointers,
+//  top level first.  Marking level 0 is the moment it leaves the set; after
+//  that any traversal that runs into it unlinks it.
+//
+
+#ifndef LockFreeSet_H
+#define LockFreeSet_H
+
+#include "epoch.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+using namespace std;
+
+template <typename T>
+class LockFreeSet{
+public:
+    LockFreeSet();
+
+    // not safe against concurrent use, like any destructor
+    ~LockFreeSet();
+
+    LockFreeSet(const LockFreeSet&) = delete;
+    LockFreeSet& operator=(const LockFreeSet&) = delete;
+
+    // adds x.  Returns false if it was already there
+    bool Red_Black_Insert(const T& x);
+
+    // removes x.  Returns true if it's found, False otherwise
+    bool Red_Black_Delete(const T& x);
+
+    // Determines whether x is in the set.  Never writes anything shared
+    bool Find(const T& x) const;
+
+    // dumps the items into a sorted vector.  Concurrent updates may or may
+    // not show up, but nothing is listed twice and the order holds
+    void Dump_To_Vector(vector<T>& V) const;
+
+private:
+    static const int MAX_LEVEL = 24;
+
+    // a node is this header followed by "height" links
+    struct Node{
+        T item;
+        int height;
+        atomic<int> owners; // the inserter and the deleter, see Red_Black_Delete
+    };
+
+    Node* head; // MAX_LEVEL links, no item
+
+    static atomic<uintptr_t>& Link(Node* n, int level);
+    static Node* Pointer(uintptr_t link);
+    static bool Marked(uintptr_t link);
+
+    static Node* New_Node(const T& x, int height);
+    static void Free_Node(void* p);
+
+    // height for a new node: level l with probability 2^-l
+    static int Random_Height();
+
+    // fills preds/succs with, at every level, the last node < x and the one
+    // after it, unlinking every marked node it passes.  Returns whether
+    // succs[0] holds x
+    bool Find_Position(const T& x, Node** preds, Node** succs) const;
+
+    // drops one claim on n and retires it when none are left
+    static void Release(Node* n);
+};
+
+
+template <typename T>
+atomic<uintptr_t>& LockFreeSet<T>::Link(Node* n, int level){
+    const size_t align = alignof(atomic<uintptr_t>);
+    const size_t offset = (sizeof(Node) + align - 1) / align * align;
+    return reinterpret_cast<atomic<uintptr_t>*>(reinterpret_cast<char*>(n) + offset)[level];
+}
+
+template <typename T>
+typename LockFreeSet<T>::Node* LockFreeSet<T>::Pointer(uintptr_t link){
+    return reinterpret_cast<Node*>(link & ~(uintptr_t)1);
+}
+
+template <typename T>
+bool LockFreeSet<T>::Marked(uintptr_t link){
+    return (link & 1) != 0;
+}
+
+template <typename T>
+typename LockFreeSet<T>::Node* LockFreeSet<T>::New_Node(const T& x, int height){
+    const size_t align = alignof(atomic<uintptr_t>);
+    const size_t offset = (sizeof(Node) + align - 1) / align * align;
+    void* memory = ::operator new(offset + height * sizeof(atomic<uintptr_t>));
+    Node* n = new (memory) Node;
+    n->item = x;
+    n->height = height;
+    n->owners.store(2, memory_order_relaxed);
+    for(int l = 0; l < height; l++)
+        new (&Link(n, l)) atomic<uintptr_t>(0);
+    return n;
+}
+
+template <typename T>
+void LockFreeSet<T>::Free_Node(void* p){
+    Node* n = static_cast<Node*>(p);
+    n->~Node(); // the links are trivially destructible
+    ::operator delete(p);
+}
+
+template <typename T>
+int LockFreeSet<T>::Random_Height(){
+    static thread_local uint32_t state = 0;
+    if(state == 0) // seed each thread differently
+        state = (uint32_t)(uintptr_t)&state | 1;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    int height = 1;
+    uint32_t bits = state;
+    while((bits & 1) != 0 && height < MAX_LEVEL){
+        height++;
+        bits >>= 1;
+    }
+    return height;
+}
+
+template <typename T>
+LockFreeSet<T>::LockFreeSet(){
+    head = New_Node(T(), MAX_LEVEL);
+}
+
+template <typename T>
+LockFreeSet<T>::~LockFreeSet(){
+    Node* cur = head;
+    while(cur != NULL){
+        Node* next = Pointer(Link(cur, 0).load(memory_order_relaxed));
+        Free_Node(cur);
+        cur = next;
+    }
+}
+
+// Red_Black_Insert: the node is in the set once it's linked at level 0; the
+// levels above are only shortcuts and are linked afterwards, giving up as
+// soon as the node turns out to be deleted meanwhile
+template <typename T>
+bool LockFreeSet<T>::Red_Black_Insert(const T& x){
+    EpochGuard guard;
+    Node* preds[MAX_LEVEL];
+    Node* succs[MAX_LEVEL];
+    int height = Random_Height();
+    Node* n = NULL;
+    while(true){
+        if(Find_Position(x, preds, succs)){
+            if(n != NULL)
+                Free_Node(n); // never published
+            return false;
+        }
+        if(n == NULL)
+            n = New_Node(x, height);
+        for(int l = 0; l < height; l++)
+            Link(n, l).store((uintptr_t)succs[l], memory_order_relaxed);
+        uintptr_t expected = (uintptr_t)succs[0];
+        if(Link(preds[0], 0).compare_exchange_strong(expected, (uintptr_t)n,
+                                                    memory_order_release, memory_order_relaxed))
+            break;
+    }
+    for(int l = 1; l < height; l++){
+        while(true){
+            uintptr_t mine = Link(n, l).load(memory_order_acquire);
+            if(Marked(mine)) // being deleted, stop building
+                goto linked;
+            if(Pointer(mine) != succs[l]
+               && !Link(n, l).compare_exchange_strong(mine, (uintptr_t)succs[l], memory_order_acq_rel))
+                continue; // marked under us, the check above ends it
+            uintptr_t expected = (uintptr_t)succs[l];
+            if(Link(preds[l], l).compare_exchange_strong(expected, (uintptr_t)n,
+                                                        memory_order_release, memory_order_relaxed))
+                break;
+            // something changed around us.  If n itself is gone from level
+            // 0, whatever we linked is for Find_Position to clean up
+            if(!Find_Position(x, preds, succs) || succs[0] != n)
+                goto linked;
+        }
+    }
+linked:
+    // a delete may have run between our links and not seen the last one
+    if(Marked(Link(n, 0).load(memory_order_acquire)))
+        Find_Position(x, preds, succs);
+    Release(n);
+    return true;
+}
+
+// Red_Black_Delete: whoever marks level 0 owns the delete.  The node is only
+// retired once both it and the inserter, which may still be linking upper
+// levels, have made sure it's unlinked everywhere: each drops one claim
+template <typename T>
+bool LockFreeSet<T>::Red_Black_Delete(const T& x){
+    EpochGuard guard;
+    Node* preds[MAX_LEVEL];
+    Node* succs[MAX_LEVEL];
+    if(!Find_Position(x, preds, succs))
+        return false;
+    Node* n = succs[0];
+    for(int l = n->height - 1; l > 0; l--){
+        uintptr_t link = Link(n, l).load(memory_order_acquire);
+        while(!Marked(link))
+            Link(n, l).compare_exchange_weak(link, link | 1, memory_order_acq_rel);
+    }
+    uintptr_t link = Link(n, 0).load(memory_order_acquire);
+    while(true){
+        if(Marked(link)) // someone else deleted it first
+            return false;
+        if(Link(n, 0).compare_exchange_weak(link, link | 1, memory_order_acq_rel))
+            break;
+    }
+    Find_Position(x, preds, succs); // unlinks it
+    Release(n);
+    return true;
+}
+
+template <typename T>
+bool LockFreeSet<T>::Find(const T& x) const{
+    EpochGuard guard;
+    Node* pred = head;
+    Node* cur = NULL;
+    for(int l = MAX_LEVEL - 1; l >= 0; l--){
+        cur = Pointer(Link(pred, l).load(memory_order_acquire));
+        while(cur != NULL){
+            uintptr_t next = Link(cur, l).load(memory_order_acquire);
+            if(Marked(next)){ // step over deleted nodes without unlinking
+                cur = Pointer(next);
+                continue;
+            }
+            if(!(cur->item < x))
+                break;
+            pred = cur;
+            cur = Pointer(next);
+        }
+    }
+    return cur != NULL && cur->item == x && !Marked(Link(cur, 0).load(memory_order_acquire));
+}
+
+template <typename T>
+void LockFreeSet<T>::Dump_To_Vector(vector<T>& v) const{
+    EpochGuard guard;
+    Node* cur = Pointer(Link(head, 0).load(memory_order_acquire));
+    while(cur != NULL){
+        uintptr_t next = Link(cur, 0).load(memory_order_acquire);
+        if(!Marked(next))
+            v.push_back(cur->item);
+        cur = Pointer(next);
+    }
+}
+
+template <typename T>
+bool LockFreeSet<T>::Find_Position(const T& x, Node** preds, Node** succs) const{
+retry:
+    Node* pred = head;
+    Node* cur = NULL;
+    for(int l = MAX_LEVEL - 1; l >= 0; l--){
+        cur = Pointer(Link(pred, l).load(memory_order_acquire));
+        while(cur != NULL){
+            uintptr_t next = Link(cur, l).load(memory_order_acquire);
+            if(Marked(next)){ // unlink it, or start over if pred changed
+                uintptr_t expected = (uintptr_t)cur;
+                if(!Link(pred, l).compare_exchange_strong(expected, next & ~(uintptr_t)1,
+                                                         memory_order_acq_rel, memory_order_acquire))
+                    goto retry;
+                cur = Pointer(next);
+                continue;
+            }
+            if(!(cur->item < x))
+                break;
+            pred = cur;
+            cur = Pointer(next);
+        }
+        preds[l] = pred;
+        succs[l] = cur;
+    }
+    return cur != NULL && cur->item == x;
+}
+
+template <typename T>
+void LockFreeSet<T>::Release(Node* n){
+    if(n->owners.fetch_sub(1, memory_order_acq_rel) == 1)
+        EpochDomain::Global().Retire(n, Free_Node);
+}
+
+#endif
@@ -0,0 +1,120 @@
+//
+//  reclaimer.h
+//  RedBlackTree
+//
+//  Frees things on a background thread.  Whoever has cut a big structure
+//  loose, like the prefix RedBlackTree::Expire_Before splits off, hands it to
+//  Retire with the function that takes it apart, and gets on with its work
+//  while the one thread behind the queue does the freeing.
+//
+//  Unlike the epoch domain this is no help with readers still looking at
+//  what's retired: it has to be unreachable already.
+//
+
+#ifndef Reclaimer_H
+#define Reclaimer_H
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+class BackgroundReclaimer{
+public:
+    // the one reclaimer everything shares.  Its thread starts with the first
+    // Retire
+    static BackgroundReclaimer& Global();
+
+    // frees whatever is still queued and stops the thread
+    ~BackgroundReclaimer();
+
+    // frees p with "release" on the background thread, soon
+    void Retire(void* p, void (*release)(void*));
+
+    // waits until everything retired so far has been freed
+    void Drain();
+
+private:
+    struct Retired{
+        void* p;
+        void (*release)(void*);
+    };
+
+    mutex lock;
+    condition_variable wake; // there's work, or it's time to stop
+    condition_variable idle; // the queue has run dry
+    vector<Retired> queue;
+    bool busy;               // the thread is freeing a batch it took off the queue
+    bool stopping;
+    thread worker;
+
+    BackgroundReclaimer();
+    BackgroundReclaimer(const BackgroundReclaimer&) = delete;
+    BackgroundReclaimer& operator=(const BackgroundReclaimer&) = delete;
+
+    void Run();
+};
+
+
+inline BackgroundReclaimer& BackgroundReclaimer::Global(){
+    static BackgroundReclaimer reclaimer;
+    return reclaimer;
+}
+
+inline BackgroundReclaimer::BackgroundReclaimer(){
+    busy = false;
+    stopping = false;
+}
+
+inline BackgroundReclaimer::~BackgroundReclaimer(){
+    {
+        lock_guard<mutex> hold(lock);
+        stopping = true;
+    }
+    wake.notify_one();
+    if(worker.joinable())
+        worker.join();
+    for(size_t i = 0; i < queue.size(); i++)
+        queue[i].release(queue[i].p);
+}
+
+inline void BackgroundReclaimer::Retire(void* p, void (*release)(void*)){
+    Retired item = {p, release};
+    {
+        lock_guard<mutex> hold(lock);
+        queue.push_back(item);
+        if(!worker.joinable())
+            worker = thread(&BackgroundReclaimer::Run, this);
+    }
+    wake.notify_one();
+}
+
+inline void BackgroundReclaimer::Drain(){
+    unique_lock<mutex> hold(lock);
+    idle.wait(hold, [this]{ return queue.empty() && !busy; });
+}
+
+// Run: takes the whole queue at once and frees it with the lock let go, so
+// Retire never waits behind a free
+inline void BackgroundReclaimer::Run(){
+    vector<Retired> batch;
+    unique_lock<mutex> hold(lock);
+    while(true){
+        wake.wait(hold, [this]{ return stopping || !queue.empty(); });
+        if(queue.empty()) // stopping
+            return;
+        batch.swap(queue);
+        busy = true;
+        hold.unlock();
+        for(size_t i = 0; i < batch.size(); i++)
+            batch[i].release(batch[i].p);
+        batch.clear();
+        hold.lock();
+        busy = false;
+        if(queue.empty())
+            idle.notify_all();
+    }
+}
+
+#endif
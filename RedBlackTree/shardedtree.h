@@ -0,0 +1,363 @@
+//
+//  shardedtree.h
+//  RedBlackTree
+//
+//  A RedBlackTree split by key range into shards, each with its own lock, so
+//  writers working on different parts of the key space don't queue up behind
+//  one root.  Shards start as one and split at their median once they've
+//  taken enough writes, so the busy ranges end up with the most shards.
+//
+//  A split lays each half out with Build_From_Sorted, so every shard but
+//  the first keeps its nodes in one block of its own, the tree's arena,
+//  and reuses the slots its deletes free before it goes to the heap.
+//
+//  Routing doesn't take any shared lock: the shard list is an immutable
+//  table behind an atomic pointer, and a split publishes a new one.  An
+//  operation that locks a shard which has just been split away notices and
+//  routes again.
+//
+
+#ifndef ShardedTree_H
+#define ShardedTree_H
+
+#include "redblacktree.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+using namespace std;
+
+template <typename T>
+class ShardedTree{
+public:
+    // maxShards caps the splitting.  A shard splits once it has taken
+    // splitWrites inserts and deletes and holds at least minSplitSize items
+    ShardedTree(int maxShards = 64, long splitWrites = 1 << 16, long minSplitSize = 1024);
+
+    ShardedTree(const ShardedTree&) = delete;
+    ShardedTree& operator=(const ShardedTree&) = delete;
+
+    // the same operations as RedBlackTree, safe to call from any number of
+    // threads at once
+    void Red_Black_Insert(const T& x);
+
+    bool Red_Black_Delete(const T& x);
+
+    bool Find(const T& x) const;
+
+    // dumps all items into a sorted vector.  Each shard is copied under its
+    // own lock, so it's not a snapshot of all of them at one instant
+    void Dump_To_Vector(vector<T>& V) const;
+
+    // Calls visit(item) for every item in sorted order.  The shards cover
+    // disjoint ranges, so merging them in order is just going through them
+    // one after another, each under its own lock only while it's visited.
+    // Same consistency as Dump_To_Vector.  visit runs under a shard's lock,
+    // so it mustn't call back into the tree
+    template <typename Visitor>
+    void Visit_In_Order(Visitor visit) const;
+
+    // number of items, summed over the shards
+    long Size() const;
+
+    int Shard_Count() const;
+
+    // checks every live shard's tree, its count, and that its items lie in
+    // its range, saying on cerr what's wrong if anything is.  Each shard is
+    // checked under its own lock, so it can run alongside writers.  O(n)
+    bool Verify() const;
+
+private:
+    // one key range.  It holds the items >= low (the first shard's low is
+    // never looked at) and < the next shard's low
+    struct Shard{
+        mutex lock;
+        RedBlackTree<T> tree;
+        T low;
+        long size;
+        long writes;  // inserts and deletes since this shard was made
+        bool retired; // split away, its items now live in two new shards
+    };
+
+    // the shards in key order.  Never changed once published
+    struct Table{
+        vector<Shard*> shards;
+    };
+
+    atomic<const Table*> current;
+    int maxShards;
+    long splitWrites;
+    long minSplitSize;
+
+    // serializes splits, and guards the lists below.  Old shards and tables
+    // are kept until the tree goes away, since a reader may still be looking
+    // at them; there are at most maxShards splits, so that's bounded
+    mutex splitLock;
+    vector<unique_ptr<Shard> > allShards;
+    vector<unique_ptr<Table> > allTables;
+
+    // the index in "table" of the shard x belongs in
+    static size_t Route(const Table& table, const T& x);
+
+    // locks and returns the live shard x belongs in
+    Shard* Lock_Shard(const T& x, unique_lock<mutex>& hold) const;
+
+    // calls each(shard) for every shard in key order, each under its own
+    // lock.  If a shard got split under it, calls restart() and starts over
+    template <typename Each, typename Restart>
+    void For_Each_Shard(Each each, Restart restart) const;
+
+    // true when "shard" should be split.  The caller holds its lock
+    bool Wants_Split(const Shard& shard) const;
+
+    // splits "shard", if it still needs it
+    void Split(Shard* shard);
+
+    Shard* New_Shard(const T& low);
+};
+
+
+template <typename T>
+ShardedTree<T>::ShardedTree(int max, long writes, long minSize){
+    maxShards = max < 1 ? 1 : max;
+    splitWrites = writes;
+    minSplitSize = minSize < 2 ? 2 : minSize;
+    Table* table = new Table;
+    allTables.push_back(unique_ptr<Table>(table));
+    table->shards.push_back(New_Shard(T()));
+    current.store(table, memory_order_release);
+}
+
+template <typename T>
+void ShardedTree<T>::Red_Black_Insert(const T& x){
+    unique_lock<mutex> hold;
+    Shard* shard = Lock_Shard(x, hold);
+    shard->tree.Red_Black_Insert(x);
+    shard->size++;
+    shard->writes++;
+    bool split = Wants_Split(*shard);
+    hold.unlock();
+    if(split)
+        Split(shard);
+}
+
+template <typename T>
+bool ShardedTree<T>::Red_Black_Delete(const T& x){
+    unique_lock<mutex> hold;
+    Shard* shard = Lock_Shard(x, hold);
+    if(!shard->tree.Red_Black_Delete(x))
+        return false;
+    shard->size--;
+    shard->writes++;
+    return true;
+}
+
+template <typename T>
+bool ShardedTree<T>::Find(const T& x) const{
+    unique_lock<mutex> hold;
+    Shard* shard = Lock_Shard(x, hold);
+    return shard->tree.Find(x);
+}
+
+template <typename T>
+void ShardedTree<T>::Dump_To_Vector(vector<T>& v) const{
+    size_t start = v.size();
+    For_Each_Shard([&v](const Shard& shard){
+        shard.tree.Dump_To_Vector(v);
+    }, [&v, start]{
+        v.resize(start);
+    });
+}
+
+// Visit_In_Order: unlike Dump_To_Vector it can't start over once something
+// has been visited.  It doesn't need to: splits only ever add boundaries, so
+// when the next shard turns out to have been split, the shard that starts at
+// its low in the newer table carries on from exactly there.  The first
+// shard's low isn't a real boundary, but nothing has been visited yet then
+template <typename T>
+template <typename Visitor>
+void ShardedTree<T>::Visit_In_Order(Visitor visit) const{
+    const Table* table = current.load(memory_order_acquire);
+    size_t i = 0;
+    while(i < table->shards.size()){
+        Shard* shard = table->shards[i];
+        unique_lock<mutex> hold(shard->lock);
+        if(shard->retired){
+            hold.unlock();
+            table = current.load(memory_order_acquire);
+            if(i > 0)
+                i = Route(*table, shard->low);
+            continue;
+        }
+        shard->tree.Visit_In_Order(visit);
+        i++;
+    }
+}
+
+template <typename T>
+long ShardedTree<T>::Size() const{
+    long total = 0;
+    For_Each_Shard([&total](const Shard& shard){
+        total += shard.size;
+    }, [&total]{
+        total = 0;
+    });
+    return total;
+}
+
+template <typename T>
+int ShardedTree<T>::Shard_Count() const{
+    return (int)current.load(memory_order_acquire)->shards.size();
+}
+
+// Verify: a shard's items are >= its own low and < the next one's, so the
+// biggest item seen so far must be below each low that comes after it
+template <typename T>
+bool ShardedTree<T>::Verify() const{
+    const char* problem = NULL;
+    bool first = true;
+    bool seenAny = false;
+    T biggest = T();
+    For_Each_Shard([&](const Shard& shard){
+        if(problem != NULL)
+            return;
+        T x = T();
+        if(!shard.tree.Verify())
+            problem = "a shard's tree is broken";
+        else if(shard.size != shard.tree.Size())
+            problem = "a shard's count is wrong";
+        else if(!first && seenAny && !(biggest < shard.low))
+            problem = "an item is at or above a later shard's low";
+        else if(!first && shard.tree.Min(x) && x < shard.low)
+            problem = "an item is below its shard's low";
+        if(shard.tree.Max(x)){
+            biggest = x;
+            seenAny = true;
+        }
+        first = false;
+    }, [&]{
+        problem = NULL;
+        first = true;
+        seenAny = false;
+    });
+    if(problem != NULL)
+        cerr << "ShardedTree::Verify: " << problem << endl;
+    return problem == NULL;
+}
+
+// Route: binary search for the last shard whose low is <= x
+template <typename T>
+size_t ShardedTree<T>::Route(const Table& table, const T& x){
+    size_t lo = 0;
+    size_t hi = table.shards.size();
+    while(hi - lo > 1){
+        size_t mid = lo + (hi - lo) / 2;
+        if(x < table.shards[mid]->low)
+            hi = mid;
+        else
+            lo = mid;
+    }
+    return lo;
+}
+
+// Lock_Shard: a split retires the shard while holding its lock, after the
+// new table is published, so once we hold a lock and the shard isn't retired
+// it's the right one; if it is, the new table is already visible
+template <typename T>
+typename ShardedTree<T>::Shard* ShardedTree<T>::Lock_Shard(const T& x, unique_lock<mutex>& hold) const{
+    while(true){
+        const Table* table = current.load(memory_order_acquire);
+        Shard* shard = table->shards[Route(*table, x)];
+        hold = unique_lock<mutex>(shard->lock);
+        if(!shard->retired)
+            return shard;
+        hold.unlock();
+    }
+}
+
+template <typename T>
+template <typename Each, typename Restart>
+void ShardedTree<T>::For_Each_Shard(Each each, Restart restart) const{
+    bool done = false;
+    while(!done){
+        const Table* table = current.load(memory_order_acquire);
+        done = true;
+        for(size_t i = 0; i < table->shards.size() && done; i++){
+            lock_guard<mutex> hold(table->shards[i]->lock);
+            if(table->shards[i]->retired){
+                restart();
+                done = false;
+            }
+            else
+                each(*table->shards[i]);
+        }
+    }
+}
+
+// Wants_Split: the caller may not hold splitLock, so the table has to be
+// loaded with acquire like any other reader's, or its shard list could be
+// read before the split that made it has finished writing it
+template <typename T>
+bool ShardedTree<T>::Wants_Split(const Shard& shard) const{
+    return shard.writes >= splitWrites && shard.size >= minSplitSize
+    && (int)current.load(memory_order_acquire)->shards.size() < maxShards;
+}
+
+// Split: the items below the median go to one new shard, the rest to
+// another.  Equal items must stay together, so if the median equals the
+// smallest item the cut moves up to the next bigger one.  The items come out
+// sorted, so each half is built in O(n) straight into its own arena
+template <typename T>
+void ShardedTree<T>::Split(Shard* shard){
+    lock_guard<mutex> serial(splitLock);
+    lock_guard<mutex> hold(shard->lock);
+    if(shard->retired || !Wants_Split(*shard)) // someone else got here first
+        return;
+    shard->writes = 0; // if it can't be cut, don't try again straight away
+
+    vector<T> items;
+    shard->tree.Dump_To_Vector(items);
+    typename vector<T>::iterator cut = lower_bound(items.begin(), items.end(), items[items.size() / 2]);
+    if(cut == items.begin())
+        cut = upper_bound(items.begin(), items.end(), items.front());
+    if(cut == items.end()) // all equal, nowhere to cut
+        return;
+
+    Shard* lower = New_Shard(shard->low);
+    Shard* upper = New_Shard(*cut);
+    vector<T> above(cut, items.end());
+    items.resize(cut - items.begin());
+    lower->tree.Build_From_Sorted(items);
+    upper->tree.Build_From_Sorted(above);
+    lower->size = (long)items.size();
+    upper->size = (long)above.size();
+
+    const Table* old = current.load(memory_order_relaxed);
+    Table* table = new Table;
+    allTables.push_back(unique_ptr<Table>(table));
+    for(size_t i = 0; i < old->shards.size(); i++){
+        if(old->shards[i] == shard){
+            table->shards.push_back(lower);
+            table->shards.push_back(upper);
+        }
+        else
+            table->shards.push_back(old->shards[i]);
+    }
+    current.store(table, memory_order_release);
+    shard->retired = true;
+    shard->tree = RedBlackTree<T>(); // nobody reads a retired shard's items
+}
+
+template <typename T>
+typename ShardedTree<T>::Shard* ShardedTree<T>::New_Shard(const T& low){
+    Shard* shard = new Shard;
+    allShards.push_back(unique_ptr<Shard>(shard));
+    shard->low = low;
+    shard->size = 0;
+    shard->writes = 0;
+    shard->retired = false;
+    return shard;
+}
+
+#endif
@@ -0,0 +1,261 @@
+//
+//  smalltree.h
+//  RedBlackTree
+//
+//  A RedBlackTree for sets that are usually tiny.  Up to N items live in a
+//  sorted array inside the object itself, with no allocation at all; the
+//  first insert past that moves them into a real RedBlackTree on the heap.
+//  A promoted tree that shrinks below N / 2 items moves back into the array,
+//  so a size hovering around N doesn't convert back and forth on every call.
+//
+//  A small set of ints costs sizeof(SmallRedBlackTree<int>) and nothing
+//  else, where a RedBlackTree costs its own object plus a node per item.
+//  Once promoted it's both: the array stays, and the tree object it points
+//  to is 64 bytes for ints, the core's rarely used state being out of line.
+//
+
+#ifndef SmallRedBlackTree_H
+#define SmallRedBlackTree_H
+
+#include "redblacktree.h"
+#include <cstddef>
+#include <iostream>
+#include <vector>
+using namespace std;
+
+template <typename T, int N = 16>
+class SmallRedBlackTree{
+public:
+    // default constructor, empty and inline
+    SmallRedBlackTree();
+    // copy constructor, deep copies the tree if the other one has one
+    SmallRedBlackTree(const SmallRedBlackTree& other);
+
+    SmallRedBlackTree& operator=(const SmallRedBlackTree& other);
+
+    ~SmallRedBlackTree();
+
+    // the same operations as RedBlackTree, on whichever form the items are in
+    void Red_Black_Insert(const T& x);
+
+    bool Red_Black_Delete(const T& x);
+
+    bool Find(const T& x) const;
+
+    void Dump_To_Vector(vector<T>& V) const;
+
+    // Calls visit(item) for every item in sorted order
+    template <typename Visitor>
+    void Visit_In_Order(Visitor visit) const;
+
+    void Print_Inorder() const;
+
+    // number of items
+    long Size() const;
+
+    // true once the items have moved out to a RedBlackTree
+    bool Is_Promoted() const;
+
+    // checks that the inline items are sorted and fit, or that the tree is
+    // sound and holds no fewer than N / 2, and says on cerr what's wrong if
+    // anything is.  For tests
+    bool Verify() const;
+
+private:
+    T small[N];              // the items while there are at most N, sorted
+    long count;
+    RedBlackTree<T>* tree;   // NULL while the items are inline
+
+    // index of the first inline item that isn't < x
+    int Lower_Bound(const T& x) const;
+
+    // moves the inline items into a new RedBlackTree
+    void Promote();
+
+    // moves the items back inline and drops the tree
+    void Demote();
+};
+
+
+template <typename T, int N>
+SmallRedBlackTree<T, N>::SmallRedBlackTree(){
+    count = 0;
+    tree = NULL;
+}
+
+template <typename T, int N>
+SmallRedBlackTree<T, N>::SmallRedBlackTree(const SmallRedBlackTree& other){
+    count = other.count;
+    tree = other.tree == NULL ? NULL : new RedBlackTree<T>(*other.tree);
+    for(int i = 0; tree == NULL && i < count; i++)
+        small[i] = other.small[i];
+}
+
+// assignment: copy first so a throwing copy leaves us untouched
+template <typename T, int N>
+SmallRedBlackTree<T, N>& SmallRedBlackTree<T, N>::operator=(const SmallRedBlackTree& other){
+    if(this != &other){
+        RedBlackTree<T>* copy = other.tree == NULL ? NULL : new RedBlackTree<T>(*other.tree);
+        delete tree;
+        tree = copy;
+        count = other.count;
+        for(int i = 0; tree == NULL && i < count; i++)
+            small[i] = other.small[i];
+    }
+    return *this;
+}
+
+template <typename T, int N>
+SmallRedBlackTree<T, N>::~SmallRedBlackTree(){
+    delete tree;
+    tree = NULL;
+}
+
+// Red_Black_Insert: equal items go after the ones already there, which
+// keeps the shifting down to the items that are really bigger
+template <typename T, int N>
+void SmallRedBlackTree<T, N>::Red_Black_Insert(const T& x){
+    if(tree == NULL && count == N)
+        Promote();
+    count++;
+    if(tree != NULL){
+        tree->Red_Black_Insert(x);
+        return;
+    }
+    int at = (int)count - 1;
+    while(at > 0 && x < small[at - 1]){
+        small[at] = small[at - 1];
+        at--;
+    }
+    small[at] = x;
+}
+
+template <typename T, int N>
+bool SmallRedBlackTree<T, N>::Red_Black_Delete(const T& x){
+    if(tree != NULL){
+        if(!tree->Red_Black_Delete(x))
+            return false;
+        count--;
+        if(count < N / 2)
+            Demote();
+        return true;
+    }
+    int at = Lower_Bound(x);
+    if(at == count || !(small[at] == x))
+        return false;
+    for(int i = at + 1; i < count; i++)
+        small[i - 1] = small[i];
+    count--;
+    return true;
+}
+
+template <typename T, int N>
+bool SmallRedBlackTree<T, N>::Find(const T& x) const{
+    if(tree != NULL)
+        return tree->Find(x);
+    int at = Lower_Bound(x);
+    return at < count && small[at] == x;
+}
+
+template <typename T, int N>
+void SmallRedBlackTree<T, N>::Dump_To_Vector(vector<T>& v) const{
+    if(tree != NULL){
+        tree->Dump_To_Vector(v);
+        return;
+    }
+    v.insert(v.end(), small, small + count);
+}
+
+template <typename T, int N>
+template <typename Visitor>
+void SmallRedBlackTree<T, N>::Visit_In_Order(Visitor visit) const{
+    if(tree == NULL){
+        for(int i = 0; i < count; i++)
+            visit(small[i]);
+        return;
+    }
+    vector<T> items;
+    tree->Dump_To_Vector(items);
+    for(size_t i = 0; i < items.size(); i++)
+        visit(items[i]);
+}
+
+template <typename T, int N>
+void SmallRedBlackTree<T, N>::Print_Inorder() const{
+    Visit_In_Order([](const T& item){
+        cout << item << " ";
+    });
+}
+
+template <typename T, int N>
+long SmallRedBlackTree<T, N>::Size() const{
+    return count;
+}
+
+template <typename T, int N>
+bool SmallRedBlackTree<T, N>::Is_Promoted() const{
+    return tree != NULL;
+}
+
+template <typename T, int N>
+bool SmallRedBlackTree<T, N>::Verify() const{
+    const char* problem = NULL;
+    if(tree != NULL){
+        if(!tree->Verify())
+            problem = "the promoted tree is broken";
+        else if(tree->Size() != count)
+            problem = "the count is wrong";
+        else if(count < N / 2)
+            problem = "a tree this small should have moved back inline";
+    }
+    else if(count < 0 || count > N)
+        problem = "more items inline than there's room for";
+    else{
+        for(int i = 1; i < count && problem == NULL; i++){
+            if(small[i] < small[i - 1])
+                problem = "the inline items are out of order";
+        }
+    }
+    if(problem != NULL)
+        cerr << "SmallRedBlackTree::Verify: " << problem << endl;
+    return problem == NULL;
+}
+
+// Lower_Bound: halves the range with a conditional move instead of a branch,
+// so a lookup costs the same whatever the comparisons say.  "base" always
+// stays in front of the answer, and the last comparison says whether the
+// answer is base itself or the one after it
+template <typename T, int N>
+int SmallRedBlackTree<T, N>::Lower_Bound(const T& x) const{
+    if(count == 0)
+        return 0;
+    const T* base = small;
+    long n = count;
+    while(n > 1){
+        long half = n / 2;
+        base = base[half] < x ? base + half : base;
+        n -= half;
+    }
+    return (int)(base - small) + (*base < x);
+}
+
+// Promote: the items are sorted, the hinted insert's best case
+template <typename T, int N>
+void SmallRedBlackTree<T, N>::Promote(){
+    tree = new RedBlackTree<T>;
+    for(int i = 0; i < count; i++)
+        tree->Red_Black_Insert_Hinted(small[i]);
+}
+
+template <typename T, int N>
+void SmallRedBlackTree<T, N>::Demote(){
+    vector<T> items;
+    items.reserve(count);
+    tree->Dump_To_Vector(items);
+    delete tree;
+    tree = NULL;
+    for(size_t i = 0; i < items.size(); i++)
+        small[i] = items[i];
+}
+
+#endif
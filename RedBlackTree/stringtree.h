@@ -0,0 +1,346 @@
+//
+//  stringtree.h
+//  RedBlackTree
+//
+//  A RedBlackTree of strings that keeps the characters out of the nodes.
+//  Every key is copied once into a shared arena of big chunks, and the node
+//  only holds a pointer and a length, 16 bytes instead of a std::string and
+//  the heap buffer behind it.  Deleted keys leave their bytes behind until
+//  they're most of the arena, when the live ones are packed into a new one.
+//
+//  Keys share bytes where they can.  A repack or a copy stores a key that's
+//  equal to or a prefix of the next bigger one ("/usr" before "/usr/lib")
+//  as a pointer into that one's bytes, so a run of duplicates or of keys
+//  each a prefix of the next costs only the longest.  With Set_Interning on,
+//  every insert does the same against the keys already there; an equal one
+//  or one the new key is a prefix of is always on its search path, but
+//  that's a second walk down the tree.  Keys that merely share a beginning
+//  ("/usr/bin", "/usr/lib") are still stored whole.
+//
+//  Lookups remember how much of the key is already known to match.  Every
+//  key in a subtree lies between the nearest ancestors it hangs left and
+//  right of, so it shares at least the shorter of the key's common prefixes
+//  with those two; comparisons start after it instead of at the first
+//  character, which is where long shared prefixes (URLs, paths) cost most.
+//
+
+#ifndef StringRedBlackTree_H
+#define StringRedBlackTree_H
+
+#include "redblacktree.h"
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+using namespace std;
+
+// a key in a StringArena, or any other bytes that outlive it
+struct ArenaKey{
+    const char* data;
+    uint32_t length;
+
+    ArenaKey() : data(""), length(0){}
+    explicit ArenaKey(string_view s) : data(s.data()), length((uint32_t)s.size()){}
+
+    string_view View() const{ return string_view(data, length); }
+};
+
+// byte order, the same as std::string's
+inline int Compare_Keys(const ArenaKey& a, const ArenaKey& b){
+    uint32_t n = a.length < b.length ? a.length : b.length;
+    int c = n == 0 ? 0 : memcmp(a.data, b.data, n);
+    if(c != 0)
+        return c;
+    return a.length < b.length ? -1 : a.length > b.length ? 1 : 0;
+}
+
+inline bool operator==(const ArenaKey& a, const ArenaKey& b){
+    return a.length == b.length && (a.length == 0 || memcmp(a.data, b.data, a.length) == 0);
+}
+inline bool operator!=(const ArenaKey& a, const ArenaKey& b){ return !(a == b); }
+inline bool operator<(const ArenaKey& a, const ArenaKey& b){ return Compare_Keys(a, b) < 0; }
+inline bool operator>(const ArenaKey& a, const ArenaKey& b){ return Compare_Keys(a, b) > 0; }
+inline bool operator<=(const ArenaKey& a, const ArenaKey& b){ return Compare_Keys(a, b) <= 0; }
+inline bool operator>=(const ArenaKey& a, const ArenaKey& b){ return Compare_Keys(a, b) >= 0; }
+
+inline ostream& operator<<(ostream& out, const ArenaKey& key){
+    return out << key.View();
+}
+
+// Append-only storage for key bytes.  Keys never move, so the pointers in
+// the tree stay good until the arena goes away
+class StringArena{
+public:
+    StringArena();
+
+    StringArena(const StringArena&) = delete;
+    StringArena& operator=(const StringArena&) = delete;
+
+    // copies s in and returns where it went
+    ArenaKey Store(string_view s);
+
+    // bytes stored so far
+    size_t Bytes() const;
+
+    // bytes allocated, the unused ends of the chunks included
+    size_t Capacity() const;
+
+private:
+    static const size_t CHUNK = 1 << 16;
+
+    vector<unique_ptr<char[]> > chunks;
+    size_t used;      // bytes of the last chunk handed out
+    size_t chunkSize; // size of the last chunk
+    size_t stored;
+    size_t capacity;
+};
+
+class StringRedBlackTree{
+public:
+    StringRedBlackTree();
+    // copy constructor, packs the other tree's keys into an arena of its own
+    StringRedBlackTree(const StringRedBlackTree& other);
+
+    StringRedBlackTree& operator=(const StringRedBlackTree& other);
+
+    // the same operations as RedBlackTree<string>
+    void Red_Black_Insert(string_view x);
+
+    bool Red_Black_Delete(string_view x);
+
+    bool Find(string_view x) const;
+
+    void Dump_To_Vector(vector<string>& V) const;
+
+    void Print_Inorder() const;
+
+    int Height() const;
+
+    // number of keys
+    long Size() const;
+
+    // bytes the arena has allocated, deleted keys not packed away yet included
+    size_t Arena_Bytes() const;
+
+    // bytes of key data in the arena, a key sharing another's counted once
+    size_t Key_Bytes() const;
+
+    // checks the tree, the key count and the live byte count, and says on
+    // cerr what's wrong if anything is.  O(n), for tests
+    bool Verify() const;
+
+    // whether inserts look for stored bytes to share before copying the
+    // key.  Off by default, it only pays when keys repeat
+    void Set_Interning(bool on);
+
+private:
+    RedBlackTree<ArenaKey> tree;
+    unique_ptr<StringArena> arena;
+    long size;
+    size_t liveBytes; // bytes of the keys still in the tree, shared or not
+    bool interning;
+
+    // looks x up.  If "donor" isn't NULL it gets a stored key whose bytes
+    // start with x, when the search passes one, and keeps its length 0 if not
+    bool Search(string_view x, ArenaKey* donor) const;
+
+    // replaces everything with "keys", sorted, copied into a new arena.  The
+    // keys may point into the old one
+    void Fill(const vector<ArenaKey>& keys);
+
+    // moves the live keys into a new arena and drops the old one
+    void Repack();
+};
+
+
+inline StringArena::StringArena(){
+    used = 0;
+    chunkSize = 0;
+    stored = 0;
+    capacity = 0;
+}
+
+// Store: a key bigger than a chunk gets one of its own
+inline ArenaKey StringArena::Store(string_view s){
+    if(chunks.empty() || chunkSize - used < s.size()){
+        chunkSize = s.size() > CHUNK ? s.size() : CHUNK;
+        chunks.push_back(unique_ptr<char[]>(new char[chunkSize]));
+        used = 0;
+        capacity += chunkSize;
+    }
+    char* at = chunks.back().get() + used;
+    if(!s.empty())
+        memcpy(at, s.data(), s.size());
+    used += s.size();
+    stored += s.size();
+    return ArenaKey(string_view(at, s.size()));
+}
+
+inline size_t StringArena::Bytes() const{
+    return stored;
+}
+
+inline size_t StringArena::Capacity() const{
+    return capacity;
+}
+
+inline StringRedBlackTree::StringRedBlackTree() : arena(new StringArena){
+    size = 0;
+    liveBytes = 0;
+    interning = false;
+}
+
+inline StringRedBlackTree::StringRedBlackTree(const StringRedBlackTree& other){
+    interning = other.interning;
+    vector<ArenaKey> keys;
+    other.tree.Dump_To_Vector(keys);
+    Fill(keys);
+}
+
+inline StringRedBlackTree& StringRedBlackTree::operator=(const StringRedBlackTree& other){
+    if(this != &other){
+        interning = other.interning;
+        vector<ArenaKey> keys;
+        other.tree.Dump_To_Vector(keys);
+        Fill(keys);
+    }
+    return *this;
+}
+
+// Red_Black_Insert: the empty key has nothing to share and isn't stored
+inline void StringRedBlackTree::Red_Black_Insert(string_view x){
+    ArenaKey donor;
+    if(interning && !x.empty())
+        Search(x, &donor);
+    if(donor.length == 0)
+        donor = arena->Store(x);
+    donor.length = (uint32_t)x.size();
+    tree.Red_Black_Insert(donor);
+    size++;
+    liveBytes += x.size();
+}
+
+// Red_Black_Delete: the key only has to compare equal, it can sit anywhere
+inline bool StringRedBlackTree::Red_Black_Delete(string_view x){
+    if(!tree.Red_Black_Delete(ArenaKey(x)))
+        return false;
+    size--;
+    liveBytes -= x.size();
+    if(arena->Bytes() > 2 * liveBytes + (1 << 16)) // mostly dead keys
+        Repack();
+    return true;
+}
+
+inline bool StringRedBlackTree::Find(string_view x) const{
+    return Search(x, NULL);
+}
+
+// Search: "lowMatch" is how much of x the nearest smaller ancestor shares
+// with it, "highMatch" the same for the nearest bigger one.  A bigger item
+// that matched all of x starts with it
+inline bool StringRedBlackTree::Search(string_view x, ArenaKey* donor) const{
+    size_t lowMatch = 0;
+    size_t highMatch = 0;
+    return tree.Find_By([x, donor, &lowMatch, &highMatch](const ArenaKey& item){
+        size_t i = lowMatch < highMatch ? lowMatch : highMatch;
+        size_t n = x.size() < item.length ? x.size() : item.length;
+        while(i < n && x[i] == item.data[i])
+            i++;
+        int c;
+        if(i < n)
+            c = (unsigned char)x[i] < (unsigned char)item.data[i] ? -1 : 1;
+        else
+            c = x.size() < item.length ? -1 : x.size() > item.length ? 1 : 0;
+        if(donor != NULL && i == x.size())
+            *donor = item;
+        if(c < 0)
+            highMatch = i;
+        else
+            lowMatch = i;
+        return c;
+    });
+}
+
+inline void StringRedBlackTree::Dump_To_Vector(vector<string>& v) const{
+    vector<ArenaKey> keys;
+    tree.Dump_To_Vector(keys);
+    for(size_t i = 0; i < keys.size(); i++)
+        v.push_back(string(keys[i].View()));
+}
+
+inline void StringRedBlackTree::Print_Inorder() const{
+    tree.Print_Inorder();
+}
+
+inline int StringRedBlackTree::Height() const{
+    return tree.Height();
+}
+
+inline long StringRedBlackTree::Size() const{
+    return size;
+}
+
+inline size_t StringRedBlackTree::Arena_Bytes() const{
+    return arena->Capacity();
+}
+
+inline size_t StringRedBlackTree::Key_Bytes() const{
+    return arena->Bytes();
+}
+
+inline bool StringRedBlackTree::Verify() const{
+    const char* problem = NULL;
+    size_t bytes = 0;
+    tree.Visit_In_Order([&bytes](const ArenaKey& key){
+        bytes += key.length;
+    });
+    if(!tree.Verify())
+        problem = "the tree is broken";
+    else if(tree.Size() != size)
+        problem = "the key count is wrong";
+    else if(bytes != liveBytes)
+        problem = "the live byte count is wrong";
+    if(problem != NULL)
+        cerr << "StringRedBlackTree::Verify: " << problem << endl;
+    return problem == NULL;
+}
+
+inline void StringRedBlackTree::Set_Interning(bool on){
+    interning = on;
+}
+
+// Fill: the keys are stored from the biggest down, so a key that's a prefix
+// of the one after it can point into it, and then inserted from the smallest
+// up, which is the hinted insert's best case.  The old arena goes last,
+// "keys" may still be reading from it
+inline void StringRedBlackTree::Fill(const vector<ArenaKey>& keys){
+    unique_ptr<StringArena> fresh(new StringArena);
+    vector<ArenaKey> stored(keys.size());
+    for(size_t i = keys.size(); i-- > 0; ){
+        string_view key = keys[i].View();
+        if(i + 1 < keys.size() && !key.empty() && stored[i + 1].View().substr(0, key.size()) == key)
+            stored[i] = ArenaKey(string_view(stored[i + 1].data, key.size()));
+        else
+            stored[i] = fresh->Store(key);
+    }
+    tree = RedBlackTree<ArenaKey>();
+    size = 0;
+    liveBytes = 0;
+    for(size_t i = 0; i < stored.size(); i++){
+        tree.Red_Black_Insert_Hinted(stored[i]);
+        size++;
+        liveBytes += stored[i].length;
+    }
+    arena.swap(fresh);
+}
+
+inline void StringRedBlackTree::Repack(){
+    vector<ArenaKey> keys;
+    tree.Dump_To_Vector(keys);
+    Fill(keys);
+}
+
+#endif
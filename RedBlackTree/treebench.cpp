@@ -0,0 +1,798 @@
+//
+//  treebench.cpp
+//  RedBlackTree
+//
+//  Micro benchmarks for the trees.  Run as
+//      rbtree_bench [workload|all] [n] [seed]
+//  Every workload prints one line per timed phase so runs can be diffed.
+//
+
+#include "tree.h"
+#include "redblacktree.h"
+#include "balancedtree.h"
+#include "shardedtree.h"
+#include "lockfreeset.h"
+#include "cowtree.h"
+#include "smalltree.h"
+#include "stringtree.h"
+#include "indexedtree.h"
+#include <chrono>
+#include <algorithm>
+#include <random>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+// keeps the optimizer from throwing away lookups whose results we don't use
+static volatile long sink;
+
+// Times "work", which performs "ops" operations, and prints the rate
+template <typename F>
+double Time_Phase(const char* workload, const char* phase, long ops, F work){
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    work();
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << workload << " " << phase << ": " << ops << " ops in " << ms << " ms ("
+    << (ms > 0 ? ops / ms / 1000.0 : 0) << " Mops/s)" << endl;
+    return ms;
+}
+
+// dumps the tree's counters when they were compiled in
+template <typename Container>
+void Print_Stats([[maybe_unused]] const Container& tree){
+#ifdef RBTREE_STATS
+    tree.Get_Stats().Print(cout);
+#endif
+}
+
+// n distinct even keys in random order, so odd keys are guaranteed misses
+static vector<int> Shuffled_Keys(int n, unsigned seed){
+    vector<int> keys(n);
+    for(int i = 0; i < n; i++)
+        keys[i] = 2 * i;
+    mt19937 rng(seed);
+    shuffle(keys.begin(), keys.end(), rng);
+    return keys;
+}
+
+// insert, hit, miss and delete n random keys
+static void Bench_Random(int n, unsigned seed){
+    vector<int> keys = Shuffled_Keys(n, seed);
+    RedBlackTree<int> tree;
+    Time_Phase("random", "insert", n, [&]{
+        for(int i = 0; i < n; i++)
+            tree.Red_Black_Insert(keys[i]);
+    });
+    Time_Phase("random", "find-hit", n, [&]{
+        long hits = 0;
+        for(int i = 0; i < n; i++)
+            hits += tree.Find(keys[i]);
+        sink = hits;
+    });
+    Time_Phase("random", "find-miss", n, [&]{
+        long hits = 0;
+        for(int i = 0; i < n; i++)
+            hits += tree.Find(keys[i] + 1);
+        sink = hits;
+    });
+    Time_Phase("random", "delete", n, [&]{
+        for(int i = 0; i < n; i++)
+            tree.Red_Black_Delete(keys[i]);
+    });
+    Print_Stats(tree);
+}
+
+// copy and destroy a tree of n random keys
+static void Bench_Teardown(int n, unsigned seed){
+    vector<int> keys = Shuffled_Keys(n, seed);
+    RedBlackTree<int>* tree = new RedBlackTree<int>;
+    for(int i = 0; i < n; i++)
+        tree->Red_Black_Insert(keys[i]);
+    RedBlackTree<int>* copy = NULL;
+    Time_Phase("teardown", "copy", n, [&]{
+        copy = new RedBlackTree<int>(*tree);
+    });
+    Time_Phase("teardown", "destroy", n, [&]{
+        delete copy;
+    });
+    CowRedBlackTree<int> handle(*tree);
+    Time_Phase("teardown", "cow-copy", n, [&]{
+        long height = 0;
+        for(int i = 0; i < n; i++){
+            CowRedBlackTree<int> shared(handle);
+            height += shared.Height();
+        }
+        sink = height;
+    });
+    delete tree;
+}
+
+// 0, 2, 4, ... with "percent" of the keys swapped with a random other key
+static vector<int> Nearly_Sorted_Keys(int n, double percent, unsigned seed){
+    vector<int> keys(n);
+    for(int i = 0; i < n; i++)
+        keys[i] = 2 * i;
+    mt19937 rng(seed);
+    uniform_int_distribution<int> pick(0, n - 1);
+    int swaps = (int)(n * percent / 100.0);
+    for(int i = 0; i < swaps; i++)
+        swap(keys[pick(rng)], keys[pick(rng)]);
+    return keys;
+}
+
+// plain insert against the finger-hinted insert on one stream of keys
+static void Bench_Hinted_Stream(const char* workload, const vector<int>& keys){
+    RedBlackTree<int> plain;
+    Time_Phase(workload, "insert", (long)keys.size(), [&]{
+        for(size_t i = 0; i < keys.size(); i++)
+            plain.Red_Black_Insert(keys[i]);
+    });
+    Print_Stats(plain);
+    RedBlackTree<int> hinted;
+    Time_Phase(workload, "insert-hinted", (long)keys.size(), [&]{
+        for(size_t i = 0; i < keys.size(); i++)
+            hinted.Red_Black_Insert_Hinted(keys[i]);
+    });
+    Print_Stats(hinted);
+}
+
+static void Bench_Sorted(int n, unsigned seed){
+    Bench_Hinted_Stream("sorted", Nearly_Sorted_Keys(n, 0, seed));
+}
+
+static void Bench_Nearly_Sorted(int n, unsigned seed){
+    Bench_Hinted_Stream("nearly-sorted", Nearly_Sorted_Keys(n, 1, seed));
+}
+
+// the random workload against one balancing policy of BalancedTree
+template <typename Tree>
+static void Bench_Policy(const vector<int>& keys){
+    string workload = string("policy-") + Tree::Policy_Name();
+    long n = (long)keys.size();
+    Tree tree;
+    Time_Phase(workload.c_str(), "insert", n, [&]{
+        for(long i = 0; i < n; i++)
+            tree.Insert(keys[i]);
+    });
+    Time_Phase(workload.c_str(), "find-hit", n, [&]{
+        long hits = 0;
+        for(long i = 0; i < n; i++)
+            hits += tree.Access(keys[i]);
+        sink = hits;
+    });
+    cout << workload << " height: " << tree.Height() << endl;
+    Time_Phase(workload.c_str(), "delete", n, [&]{
+        for(long i = 0; i < n; i++)
+            tree.Delete(keys[i]);
+    });
+    Print_Stats(tree);
+}
+
+// every BalancedTree policy on the same random keys
+static void Bench_Policies(int n, unsigned seed){
+    vector<int> keys = Shuffled_Keys(n, seed);
+    Bench_Policy<RBTree<int> >(keys);
+    Bench_Policy<AVLTree<int> >(keys);
+    Bench_Policy<WAVLTree<int> >(keys);
+    Bench_Policy<TreapTree<int> >(keys);
+    Bench_Policy<SplayTree<int> >(keys);
+    Bench_Policy<UnbalancedTree<int> >(keys);
+}
+
+// "count" draws from a Zipf distribution over ranks 0..n-1 with exponent
+// "skew": rank r comes up in proportion to 1 / (r + 1)^skew
+static vector<int> Zipf_Ranks(int n, long count, double skew, unsigned seed){
+    vector<double> cdf(n);
+    double total = 0;
+    for(int r = 0; r < n; r++){
+        total += 1.0 / pow(r + 1.0, skew);
+        cdf[r] = total;
+    }
+    mt19937 rng(seed);
+    uniform_real_distribution<double> u(0, total);
+    vector<int> ranks(count);
+    for(long i = 0; i < count; i++){
+        int r = (int)(upper_bound(cdf.begin(), cdf.end(), u(rng)) - cdf.begin());
+        ranks[i] = r < n ? r : n - 1;
+    }
+    return ranks;
+}
+
+// skewed lookups, about 90% of them on 1% of the keys: the static red-black
+// tree against the splay tree, which pulls the hot keys up to the root.
+// Ranks map to shuffled keys so the hot keys are scattered over the key
+// space rather than next to each other
+static void Bench_Zipf(int n, unsigned seed){
+    vector<int> keys = Shuffled_Keys(n, seed);
+    // a second shuffle, so the hot keys aren't the ones inserted first
+    vector<int> byRank = Shuffled_Keys(n, seed + 1);
+    vector<int> ranks = Zipf_Ranks(n, n, 1.2, seed + 2);
+    vector<int> queries(n);
+    for(int i = 0; i < n; i++)
+        queries[i] = byRank[ranks[i]];
+
+    RedBlackTree<int> rb;
+    for(int i = 0; i < n; i++)
+        rb.Red_Black_Insert(keys[i]);
+    RBTREE_STAT(rb.Reset_Stats());
+    Time_Phase("zipf", "find-red-black", n, [&]{
+        long hits = 0;
+        for(int i = 0; i < n; i++)
+            hits += rb.Find(queries[i]);
+        sink = hits;
+    });
+    Print_Stats(rb);
+
+    SplayTree<int> splay;
+    for(int i = 0; i < n; i++)
+        splay.Insert(keys[i]);
+    RBTREE_STAT(splay.Reset_Stats());
+    Time_Phase("zipf", "find-splay", n, [&]{
+        long hits = 0;
+        for(int i = 0; i < n; i++)
+            hits += splay.Access(queries[i]);
+        sink = hits;
+    });
+    Print_Stats(splay);
+}
+
+// worker threads for the concurrent workloads, at least two so there's
+// something to contend even on a single core
+static int Bench_Threads(){
+    int threads = (int)thread::hardware_concurrency();
+    return threads < 2 ? 2 : threads;
+}
+
+// runs work(t) on threads 0..threads-1 and waits for all of them
+template <typename F>
+static void Run_Threads(int threads, F work){
+    vector<thread> pool;
+    for(int t = 0; t < threads; t++)
+        pool.push_back(thread(work, t));
+    for(size_t t = 0; t < pool.size(); t++)
+        pool[t].join();
+}
+
+// RedBlackTree behind one mutex, the baseline for the concurrent containers
+template <typename T>
+class LockedRedBlackTree{
+public:
+    void Red_Black_Insert(const T& x){
+        lock_guard<mutex> hold(lock);
+        tree.Red_Black_Insert(x);
+    }
+    bool Red_Black_Delete(const T& x){
+        lock_guard<mutex> hold(lock);
+        return tree.Red_Black_Delete(x);
+    }
+    bool Find(const T& x) const{
+        lock_guard<mutex> hold(lock);
+        return tree.Find(x);
+    }
+private:
+    mutable mutex lock;
+    RedBlackTree<T> tree;
+};
+
+// every thread inserts, finds and deletes its own stripe of the keys
+template <typename Container>
+static void Bench_Concurrent(const char* workload, Container& tree, const vector<int>& keys, int threads){
+    long n = (long)keys.size();
+    Time_Phase(workload, "insert", n, [&]{
+        Run_Threads(threads, [&](int t){
+            for(long i = t; i < n; i += threads)
+                tree.Red_Black_Insert(keys[i]);
+        });
+    });
+    Time_Phase(workload, "find-hit", n, [&]{
+        Run_Threads(threads, [&](int t){
+            long hits = 0;
+            for(long i = t; i < n; i += threads)
+                hits += tree.Find(keys[i]);
+            sink = hits;
+        });
+    });
+    Time_Phase(workload, "delete", n, [&]{
+        Run_Threads(threads, [&](int t){
+            for(long i = t; i < n; i += threads)
+                tree.Red_Black_Delete(keys[i]);
+        });
+    });
+}
+
+// random keys from every core: one locked tree against the sharded one
+static void Bench_Sharded(int n, unsigned seed){
+    vector<int> keys = Shuffled_Keys(n, seed);
+    int threads = Bench_Threads();
+    cout << "sharded threads: " << threads << endl;
+    LockedRedBlackTree<int> locked;
+    Bench_Concurrent("sharded-baseline", locked, keys, threads);
+    ShardedTree<int> sharded(8 * threads);
+    Bench_Concurrent("sharded", sharded, keys, threads);
+    cout << "sharded shards: " << sharded.Shard_Count() << endl;
+}
+
+// random keys from every core: one locked tree against the lock-free set
+static void Bench_Lock_Free(int n, unsigned seed){
+    vector<int> keys = Shuffled_Keys(n, seed);
+    int threads = Bench_Threads();
+    cout << "lockfree threads: " << threads << endl;
+    LockedRedBlackTree<int> locked;
+    Bench_Concurrent("lockfree-baseline", locked, keys, threads);
+    LockFreeSet<int> set;
+    Bench_Concurrent("lockfree", set, keys, threads);
+}
+
+// prints the median, 99th percentile and worst of per-operation times
+static void Print_Latencies(const char* workload, const char* phase, vector<double>& ns){
+    if(ns.empty())
+        return;
+    sort(ns.begin(), ns.end());
+    cout << workload << " " << phase << ": p50 " << ns[ns.size() / 2] << " ns, p99 "
+    << ns[ns.size() * 99 / 100] << " ns, max " << ns.back() << " ns" << endl;
+}
+
+// times each insert on its own: the fixup done inline against relaxed mode,
+// where a short Rebalance_Step after every insert does it instead.  Only the
+// insert is in the latencies, which is what a writer would wait for if the
+// steps ran in a maintenance thread; the phase totals include them
+static void Bench_Relaxed(int n, unsigned seed){
+    vector<int> keys = Shuffled_Keys(n, seed);
+    vector<double> ns(n);
+    for(int relaxed = 0; relaxed < 2; relaxed++){
+        const char* phase = relaxed ? "insert-relaxed" : "insert";
+        RedBlackTree<int> tree;
+        tree.Set_Relaxed(relaxed != 0);
+        Time_Phase("relaxed", phase, n, [&]{
+            for(int i = 0; i < n; i++){
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                tree.Red_Black_Insert(keys[i]);
+                ns[i] = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+                if(relaxed)
+                    tree.Rebalance_Step(4);
+            }
+            tree.Set_Relaxed(false);
+        });
+        Print_Latencies("relaxed", phase, ns);
+        cout << "relaxed " << phase << " height: " << tree.Height() << endl;
+    }
+}
+
+// deletes a random tenth of the keys and inserts them straight back, over
+// and over: normal deletes against lazy ones, which just flip a flag
+static void Bench_Churn(int n, unsigned seed){
+    vector<int> keys = Shuffled_Keys(n, seed);
+    vector<int> order = Shuffled_Keys(n, seed + 1); // the batches are windows of this
+    int batch = n / 10;
+    for(int lazy = 0; lazy < 2; lazy++){
+        const char* phase = lazy ? "delete-reinsert-lazy" : "delete-reinsert";
+        RedBlackTree<int> tree;
+        for(int i = 0; i < n; i++)
+            tree.Red_Black_Insert(keys[i]);
+        tree.Set_Lazy_Delete(lazy != 0);
+        Time_Phase("churn", phase, 20L * 2 * batch, [&]{
+            for(int round = 0; round < 20; round++){
+                int start = (round * batch / 2) % (n - batch + 1);
+                for(int i = start; i < start + batch; i++)
+                    tree.Red_Black_Delete(order[i]);
+                for(int i = start; i < start + batch; i++)
+                    tree.Red_Black_Insert(order[i]);
+            }
+        });
+        Print_Stats(tree);
+    }
+}
+
+// a sliding window of n event times: each round a tenth of a window arrives
+// and the oldest tenth expires, by a delete per key, by popping the oldest
+// one at a time, and by one Expire_Before.  Event i happens at 4i plus up to
+// 15 of jitter, so arrivals are a few places out of order.  The inserts are
+// the same every way; the expiries are also timed alone
+static void Bench_Window(int n, unsigned seed){
+    int batch = n / 10;
+    const int rounds = 20;
+    vector<int> times(n + rounds * batch);
+    mt19937 rng(seed);
+    uniform_int_distribution<int> jitter(0, 15);
+    for(size_t i = 0; i < times.size(); i++)
+        times[i] = 4 * (int)i + jitter(rng);
+    const char* phases[] = { "slide-delete", "slide-pop", "slide-expire" };
+    for(int way = 0; way < 3; way++){
+        RedBlackTree<int> tree;
+        int next = 0;
+        for(; next < n; next++)
+            tree.Red_Black_Insert(times[next]);
+        int first = 0;     // the oldest event a delete per key hasn't looked at
+        vector<int> late;  // ones it looked at too early because of jitter
+        double expireMs = 0;
+        Time_Phase("window", phases[way], 2L * rounds * batch, [&]{
+            for(int round = 0; round < rounds; round++){
+                for(int i = 0; i < batch; i++, next++)
+                    tree.Red_Black_Insert(times[next]);
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                int cutoff = 4 * (next - n);
+                if(way == 0){
+                    for(size_t i = 0; i < late.size(); i++)
+                        tree.Red_Black_Delete(late[i]);
+                    late.clear();
+                    for(; first < cutoff / 4; first++){
+                        if(times[first] < cutoff)
+                            tree.Red_Black_Delete(times[first]);
+                        else
+                            late.push_back(times[first]);
+                    }
+                }
+                else if(way == 1){
+                    int oldest;
+                    while(tree.Min(oldest) && oldest < cutoff)
+                        tree.Pop_Min(oldest);
+                }
+                else
+                    tree.Expire_Before(cutoff);
+                expireMs += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            }
+        });
+        BackgroundReclaimer::Global().Drain();
+        cout << "window " << phases[way] << " expiry alone: " << expireMs << " ms ("
+        << expireMs * 1e6 / ((double)rounds * batch) << " ns per item), height " << tree.Height()
+        << ", " << tree.Size() << " left" << endl;
+        Print_Stats(tree);
+    }
+}
+
+// a double-ended priority queue of n deadlines, in the hold model: every
+// step takes the earliest (or, one in four, the latest) and puts a new one
+// back.  Pop_Min and Pop_Max against a Min or Max and a delete by key; the
+// takes are also timed alone, the inserts being the same both ways
+static void Bench_Deque(int n, unsigned seed){
+    vector<int> keys = Shuffled_Keys(n, seed);
+    mt19937 rng(seed);
+    uniform_int_distribution<int> delay(0, 2 * n);
+    vector<int> arrivals(n);
+    for(int i = 0; i < n; i++)
+        arrivals[i] = delay(rng);
+    for(int pop = 0; pop < 2; pop++){
+        const char* phase = pop ? "hold-pop" : "hold-min-delete";
+        RedBlackTree<int> tree;
+        for(int i = 0; i < n; i++)
+            tree.Red_Black_Insert(keys[i]);
+        double takeMs = 0;
+        Time_Phase("deque", phase, 2L * n, [&]{
+            long total = 0;
+            for(int i = 0; i < n; i++){
+                int x = 0;
+                bool latest = (i & 3) == 3;
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                if(pop)
+                    latest ? tree.Pop_Max(x) : tree.Pop_Min(x);
+                else{
+                    latest ? tree.Max(x) : tree.Min(x);
+                    tree.Red_Black_Delete(x);
+                }
+                takeMs += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+                total += x;
+                tree.Red_Black_Insert(x + arrivals[i]);
+            }
+            sink = total;
+        });
+        cout << "deque " << phase << " takes alone: " << takeMs * 1e6 / n << " ns each, size "
+        << tree.Size() << ", height " << tree.Height() << endl;
+        Print_Stats(tree);
+    }
+}
+
+// the plain Tree with and without Set_Randomized, on random keys and on
+// sorted ones.  Sorted keys make the plain Tree a list, so it only gets the
+// first few thousand of them
+static void Bench_Bst(int n, unsigned seed){
+    for(int order = 0; order < 2; order++){
+        for(int randomized = 0; randomized < 2; randomized++){
+            string workload = string("bst-") + (order ? "sorted" : "random") + (randomized ? "-treap" : "-plain");
+            int count = order && !randomized ? min(n, 5000) : n;
+            vector<int> keys = Shuffled_Keys(count, seed);
+            vector<int> probes(keys);
+            if(order)
+                sort(keys.begin(), keys.end());
+            Tree<int> tree;
+            tree.Set_Randomized(randomized);
+            Time_Phase(workload.c_str(), "insert", count, [&]{
+                for(int i = 0; i < count; i++)
+                    tree.Insert(keys[i]);
+            });
+            Time_Phase(workload.c_str(), "find-hit", count, [&]{
+                long hits = 0;
+                for(int i = 0; i < count; i++)
+                    hits += tree.Find(probes[i]);
+                sink = hits;
+            });
+            cout << workload << " height: " << tree.Height() << endl;
+            Time_Phase(workload.c_str(), "delete", count, [&]{
+                for(int i = 0; i < count; i++)
+                    tree.Delete(keys[i]);
+            });
+        }
+    }
+}
+
+// copying a tree's items out: the vector growing as it goes, sized once and
+// filled on one thread per core, and straight into a buffer the caller
+// already has
+static void Bench_Export(int n, unsigned seed){
+    vector<int> keys = Shuffled_Keys(n, seed);
+    RedBlackTree<int> tree;
+    for(int i = 0; i < n; i++)
+        tree.Red_Black_Insert(keys[i]);
+    vector<int> items;
+    Time_Phase("export", "dump", n, [&]{
+        tree.Dump_To_Vector(items);
+    });
+    vector<int> parallel;
+    Time_Phase("export", "dump-parallel", n, [&]{
+        tree.Dump_To_Vector_Parallel(parallel);
+    });
+    int* buffer = new int[n];
+    Time_Phase("export", "dump-to-buffer", n, [&]{
+        tree.Dump_To(buffer);
+    });
+    cout << "export threads: " << thread::hardware_concurrency() << ", matching: "
+    << (items == parallel && equal(items.begin(), items.end(), buffer)) << endl;
+    delete[] buffer;
+}
+
+// lookups that mostly miss, 80% here, with and without Set_Filter.  The
+// misses are the odd keys, spread all over the tree like the hits
+static void Bench_Filter(int n, unsigned seed){
+    vector<int> keys = Shuffled_Keys(n, seed);
+    mt19937 rng(seed + 1);
+    uniform_int_distribution<int> pick(0, n - 1);
+    vector<int> probes(n);
+    for(int i = 0; i < n; i++)
+        probes[i] = keys[pick(rng)] + (i % 5 != 0);
+    for(int filtered = 0; filtered < 2; filtered++){
+        string workload = filtered ? "filter-on" : "filter-off";
+        RedBlackTree<int> tree;
+        tree.Set_Filter(filtered);
+        Time_Phase(workload.c_str(), "insert", n, [&]{
+            for(int i = 0; i < n; i++)
+                tree.Red_Black_Insert(keys[i]);
+        });
+        Time_Phase(workload.c_str(), "find-80%-miss", n, [&]{
+            long hits = 0;
+            for(int i = 0; i < n; i++)
+                hits += tree.Find(probes[i]);
+            sink = hits;
+        });
+        Time_Phase(workload.c_str(), "find-all-miss", n, [&]{
+            long hits = 0;
+            for(int i = 0; i < n; i++)
+                hits += tree.Find(keys[i] + 1);
+            sink = hits;
+        });
+        vector<bool> found;
+        Time_Phase(workload.c_str(), "find-many-80%-miss", n, [&]{
+            tree.Find_Many(probes, found);
+        });
+        Time_Phase(workload.c_str(), "delete-half", n / 2, [&]{
+            for(int i = 0; i < n / 2; i++)
+                tree.Red_Black_Delete(keys[i]);
+        });
+        Time_Phase(workload.c_str(), "find-after-deletes", n, [&]{
+            long hits = 0;
+            for(int i = 0; i < n; i++)
+                hits += tree.Find(probes[i]);
+            sink = hits;
+        });
+        Print_Stats(tree);
+    }
+}
+
+// n keys spread over n / 8 sets of 8, each a RedBlackTree against each a
+// SmallRedBlackTree.  The memory is what the objects and their nodes take,
+// before allocator overhead
+template <typename Set>
+static void Bench_Tiny_Sets(const char* phase, const vector<int>& keys, size_t nodeBytes){
+    size_t sets = keys.size() / 8;
+    vector<Set> all(sets);
+    string insert = string(phase) + "-insert";
+    string find = string(phase) + "-find";
+    Time_Phase("small", insert.c_str(), (long)keys.size(), [&]{
+        for(size_t i = 0; i < keys.size(); i++)
+            all[i % sets].Red_Black_Insert(keys[i]);
+    });
+    Time_Phase("small", find.c_str(), (long)keys.size(), [&]{
+        long hits = 0;
+        for(size_t i = 0; i < keys.size(); i++)
+            hits += all[i % sets].Find(keys[i]);
+        sink = hits;
+    });
+    cout << "small " << phase << " bytes per set: " << sizeof(Set) + 8 * nodeBytes << endl;
+}
+
+static void Bench_Small(int n, unsigned seed){
+    vector<int> keys = Shuffled_Keys(n, seed);
+    Bench_Tiny_Sets<RedBlackTree<int> >("tree", keys, sizeof(BalancedTreeNode<int>));
+    Bench_Tiny_Sets<SmallRedBlackTree<int> >("inline", keys, 0);
+}
+
+// n random hits and misses one Find at a time against one Find_Many.  The
+// gain grows with the tree, it's all about memory latency
+static void Bench_Batch(int n, unsigned seed){
+    vector<int> keys = Shuffled_Keys(n, seed);
+    RedBlackTree<int> tree;
+    for(int i = 0; i < n; i++)
+        tree.Red_Black_Insert(keys[i]);
+    vector<int> probes = Shuffled_Keys(n, seed + 1);
+    for(int i = 0; i < n; i += 2)
+        probes[i]++; // half of them misses
+    vector<bool> found;
+    Time_Phase("batch", "find", n, [&]{
+        long hits = 0;
+        for(int i = 0; i < n; i++)
+            hits += tree.Find(probes[i]);
+        sink = hits;
+    });
+    Time_Phase("batch", "find-many", n, [&]{
+        tree.Find_Many(probes, found);
+        sink = found[0];
+    });
+}
+
+// URL-like keys sharing long prefixes
+static vector<string> Url_Keys(int n, unsigned seed){
+    vector<int> ids = Shuffled_Keys(n, seed);
+    vector<string> keys(n);
+    for(int i = 0; i < n; i++)
+        keys[i] = "https://static.example.com/assets/v2/images/users/" + to_string(ids[i] % 1000)
+        + "/avatar-" + to_string(ids[i]) + ".png";
+    return keys;
+}
+
+// RedBlackTree<string> against StringRedBlackTree on the same keys.  Memory
+// is the nodes plus the string buffers or the arena, before allocator overhead
+static void Bench_Strings(int n, unsigned seed){
+    vector<string> keys = Url_Keys(n, seed);
+    size_t heapBytes = 0;
+    for(int i = 0; i < n; i++)
+        if(keys[i].size() > 15) // past the small string buffer
+            heapBytes += keys[i].size() + 1;
+    RedBlackTree<string> plain;
+    Time_Phase("strings", "insert", n, [&]{
+        for(int i = 0; i < n; i++)
+            plain.Red_Black_Insert(keys[i]);
+    });
+    Time_Phase("strings", "find", n, [&]{
+        long hits = 0;
+        for(int i = 0; i < n; i++)
+            hits += plain.Find(keys[i]);
+        sink = hits;
+    });
+    cout << "strings bytes: " << n * sizeof(BalancedTreeNode<string>) + heapBytes << endl;
+    StringRedBlackTree arena;
+    Time_Phase("strings", "insert-arena", n, [&]{
+        for(int i = 0; i < n; i++)
+            arena.Red_Black_Insert(keys[i]);
+    });
+    Time_Phase("strings", "find-arena", n, [&]{
+        long hits = 0;
+        for(int i = 0; i < n; i++)
+            hits += arena.Find(keys[i]);
+        sink = hits;
+    });
+    cout << "strings bytes-arena: " << n * sizeof(BalancedTreeNode<ArenaKey>) + arena.Arena_Bytes() << endl;
+}
+
+// the random workload on IndexedRedBlackTree, plus what each tree's nodes
+// take before allocator overhead
+static void Bench_Indexed(int n, unsigned seed){
+    vector<int> keys = Shuffled_Keys(n, seed);
+    IndexedRedBlackTree<int> tree;
+    Time_Phase("indexed", "insert", n, [&]{
+        for(int i = 0; i < n; i++)
+            tree.Red_Black_Insert(keys[i]);
+    });
+    Time_Phase("indexed", "find-hit", n, [&]{
+        long hits = 0;
+        for(int i = 0; i < n; i++)
+            hits += tree.Find(keys[i]);
+        sink = hits;
+    });
+    Time_Phase("indexed", "find-miss", n, [&]{
+        long hits = 0;
+        for(int i = 0; i < n; i++)
+            hits += tree.Find(keys[i] + 1);
+        sink = hits;
+    });
+    cout << "indexed bytes: " << tree.Bytes() << " (pointer nodes: "
+    << (size_t)n * sizeof(BalancedTreeNode<int>) << ")" << endl;
+    Time_Phase("indexed", "delete", n, [&]{
+        for(int i = 0; i < n; i++)
+            tree.Red_Black_Delete(keys[i]);
+    });
+}
+
+// lookups on a churned tree, then again once Compact has moved the nodes
+// into one van Emde Boas block.  Inserting 2n random keys and deleting half
+// of them leaves the survivors scattered over the heap
+static void Bench_Defrag(int n, unsigned seed){
+    vector<int> keys = Shuffled_Keys(2 * n, seed);
+    RedBlackTree<int> tree;
+    for(int i = 0; i < 2 * n; i++)
+        tree.Red_Black_Insert(keys[i]);
+    for(int i = 0; i < 2 * n; i += 2)
+        tree.Red_Black_Delete(keys[i]);
+    vector<int> probes = Shuffled_Keys(2 * n, seed + 1);
+    vector<double> ns(n);
+    for(int compacted = 0; compacted < 2; compacted++){
+        const char* phase = compacted ? "find-compacted" : "find";
+        if(compacted)
+            Time_Phase("defrag", "compact", n, [&]{
+                tree.Compact();
+            });
+        Time_Phase("defrag", phase, n, [&]{
+            long hits = 0;
+            for(int i = 0; i < n; i++)
+                hits += tree.Find(probes[i]);
+            sink = hits;
+        });
+        for(int i = 0; i < n; i++){
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            sink = tree.Find(probes[n + i]);
+            ns[i] = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+        }
+        Print_Latencies("defrag", phase, ns);
+    }
+}
+
+struct Workload{
+    const char* name;
+    void (*run)(int n, unsigned seed);
+};
+
+static const Workload workloads[] = {
+    {"random", Bench_Random},
+    {"teardown", Bench_Teardown},
+    {"sorted", Bench_Sorted},
+    {"nearly-sorted", Bench_Nearly_Sorted},
+    {"policies", Bench_Policies},
+    {"zipf", Bench_Zipf},
+    {"sharded", Bench_Sharded},
+    {"lockfree", Bench_Lock_Free},
+    {"relaxed", Bench_Relaxed},
+    {"churn", Bench_Churn},
+    {"small", Bench_Small},
+    {"batch", Bench_Batch},
+    {"strings", Bench_Strings},
+    {"indexed", Bench_Indexed},
+    {"defrag", Bench_Defrag},
+    {"window", Bench_Window},
+    {"deque", Bench_Deque},
+    {"bst", Bench_Bst},
+    {"export", Bench_Export},
+    {"filter", Bench_Filter},
+};
+
+int main(int argc, char* argv[]){
+    const char* which = argc > 1 ? argv[1] : "all";
+    int n = argc > 2 ? atoi(argv[2]) : 1000000;
+    unsigned seed = argc > 3 ? (unsigned)atoi(argv[3]) : 42;
+
+    bool ran = false;
+    for(size_t i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++){
+        if(strcmp(which, "all") == 0 || strcmp(which, workloads[i].name) == 0){
+            workloads[i].run(n, seed);
+            ran = true;
+        }
+    }
+    if(!ran){
+        cerr << "unknown workload " << which << ", expected one of: all";
+        for(size_t i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++)
+            cerr << " " << workloads[i].name;
+        cerr << endl;
+        return 1;
+    }
+    return 0;
+}
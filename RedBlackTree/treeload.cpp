@@ -0,0 +1,274 @@
+//
+//  treeload.cpp
+//  RedBlackTree
+//
+//  Loads a key file into a RedBlackTree and reports how fast it went.  Run as
+//      rbtree_load [--binary] [--threads n] [--query file]... keyfile
+//  A text file holds integers separated by whitespace or commas, a binary one
+//  native-endian 64-bit integers.  The file is mapped, parsed in parallel
+//  chunks, sorted and bulk built with Build_From_Sorted.  Each query file is
+//  read the same way and looked up with Find_Many.
+//
+
+#include "redblacktree.h"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace std;
+
+typedef long long Key;
+
+// a whole file mapped read-only.  An empty file maps to nothing
+class MappedFile{
+public:
+    MappedFile() : data(NULL), size(0){}
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // false, with the reason on cerr, if it can't be opened or mapped
+    bool Open(const char* path);
+
+    const char* data;
+    size_t size;
+};
+
+MappedFile::~MappedFile(){
+    if(data != NULL)
+        munmap((void*)data, size);
+}
+
+bool MappedFile::Open(const char* path){
+    int fd = open(path, O_RDONLY);
+    if(fd < 0){
+        cerr << path << ": " << strerror(errno) << endl;
+        return false;
+    }
+    struct stat info;
+    if(fstat(fd, &info) != 0){
+        cerr << path << ": " << strerror(errno) << endl;
+        close(fd);
+        return false;
+    }
+    size = (size_t)info.st_size;
+    if(size > 0){
+        void* p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(p == MAP_FAILED){
+            cerr << path << ": " << strerror(errno) << endl;
+            close(fd);
+            return false;
+        }
+        madvise(p, size, MADV_SEQUENTIAL);
+        data = (const char*)p;
+    }
+    close(fd);
+    return true;
+}
+
+static double Ms_Since(chrono::steady_clock::time_point start){
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+// runs work(t) on threads 0..threads-1 and waits for all of them
+template <typename F>
+static void Run_Threads(int threads, F work){
+    vector<thread> pool;
+    for(int t = 0; t < threads; t++)
+        pool.push_back(thread(work, t));
+    for(size_t t = 0; t < pool.size(); t++)
+        pool[t].join();
+}
+
+static bool Is_Separator(char c){
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == ',';
+}
+
+// Parse_Text: each chunk boundary is moved forward to a separator so no
+// number is cut in two.  Anything that isn't a whole number is counted in
+// "bad" and skipped
+static void Parse_Text(const char* data, size_t size, int threads, vector<vector<Key> >& parts, long& bad){
+    vector<size_t> cut(threads + 1);
+    for(int t = 0; t <= threads; t++){
+        size_t at = (size_t)((double)size * t / threads);
+        while(t > 0 && at < size && !Is_Separator(data[at]))
+            at++;
+        cut[t] = t == threads ? size : at;
+    }
+    vector<long> bads(threads, 0);
+    parts.assign(threads, vector<Key>());
+    Run_Threads(threads, [&](int t){
+        const char* cur = data + cut[t];
+        const char* end = data + cut[t + 1];
+        vector<Key>& out = parts[t];
+        out.reserve((end - cur) / 8);
+        while(cur < end){
+            if(Is_Separator(*cur)){
+                cur++;
+                continue;
+            }
+            Key value;
+            from_chars_result r = from_chars(cur, end, value);
+            if(r.ec == errc() && (r.ptr == end || Is_Separator(*r.ptr)))
+                out.push_back(value);
+            else{
+                bads[t]++;
+                r.ptr = cur;
+                while(r.ptr < end && !Is_Separator(*r.ptr))
+                    r.ptr++;
+            }
+            cur = r.ptr;
+        }
+    });
+    bad = 0;
+    for(int t = 0; t < threads; t++)
+        bad += bads[t];
+}
+
+// Parse_Binary: just copies, in parallel.  A trailing partial key is bad
+static void Parse_Binary(const char* data, size_t size, int threads, vector<vector<Key> >& parts, long& bad){
+    size_t count = size / sizeof(Key);
+    bad = size % sizeof(Key) != 0;
+    parts.assign(threads, vector<Key>());
+    Run_Threads(threads, [&](int t){
+        size_t first = count * t / threads;
+        size_t last = count * (t + 1) / threads;
+        parts[t].resize(last - first);
+        if(last > first)
+            memcpy(parts[t].data(), data + first * sizeof(Key), (last - first) * sizeof(Key));
+    });
+}
+
+// Sort_Parts: every part is sorted on its own thread, then neighbouring
+// runs are merged in rounds until one is left
+static void Sort_Parts(vector<vector<Key> >& parts, vector<Key>& keys){
+    int threads = (int)parts.size();
+    Run_Threads(threads, [&](int t){
+        sort(parts[t].begin(), parts[t].end());
+    });
+    vector<size_t> bounds(1, 0);
+    size_t total = 0;
+    for(int t = 0; t < threads; t++)
+        total += parts[t].size();
+    keys.clear();
+    keys.reserve(total);
+    for(int t = 0; t < threads; t++){
+        keys.insert(keys.end(), parts[t].begin(), parts[t].end());
+        vector<Key>().swap(parts[t]);
+        bounds.push_back(keys.size());
+    }
+    while(bounds.size() > 2){
+        vector<size_t> merged(1, 0);
+        int pairs = (int)(bounds.size() - 1) / 2;
+        Run_Threads(pairs, [&](int p){
+            inplace_merge(keys.begin() + bounds[2 * p], keys.begin() + bounds[2 * p + 1],
+                          keys.begin() + bounds[2 * p + 2]);
+        });
+        for(size_t i = 2; i < bounds.size(); i += 2)
+            merged.push_back(bounds[i]);
+        if(merged.back() != bounds.back()) // an odd run out, it waits a round
+            merged.push_back(bounds.back());
+        bounds.swap(merged);
+    }
+}
+
+// maps and parses "path" into sorted keys, reporting each phase as "what"
+static bool Load_Keys(const char* what, const char* path, bool binary, int threads, vector<Key>& keys){
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    MappedFile file;
+    if(!file.Open(path))
+        return false;
+    double mb = file.size / 1e6;
+    vector<vector<Key> > parts;
+    long bad = 0;
+    chrono::steady_clock::time_point parse = chrono::steady_clock::now();
+    if(binary)
+        Parse_Binary(file.data, file.size, threads, parts, bad);
+    else
+        Parse_Text(file.data, file.size, threads, parts, bad);
+    double parseMs = Ms_Since(parse);
+    chrono::steady_clock::time_point sorting = chrono::steady_clock::now();
+    Sort_Parts(parts, keys);
+    double sortMs = Ms_Since(sorting);
+    double ms = Ms_Since(start);
+    cout << what << " parse: " << mb << " MB in " << parseMs << " ms ("
+    << (parseMs > 0 ? mb / parseMs * 1000.0 : 0) << " MB/s)" << endl;
+    cout << what << " sort: " << keys.size() << " keys in " << sortMs << " ms" << endl;
+    if(bad > 0)
+        cerr << path << ": skipped " << bad << " malformed entries" << endl;
+    cout << what << " read: " << keys.size() << " keys, " << mb << " MB in " << ms << " ms" << endl;
+    return true;
+}
+
+static void Usage(){
+    cerr << "usage: rbtree_load [--binary] [--threads n] [--query file]... keyfile" << endl;
+}
+
+int main(int argc, char* argv[]){
+    bool binary = false;
+    int threads = (int)thread::hardware_concurrency();
+    vector<const char*> queries;
+    const char* keyFile = NULL;
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "--binary") == 0)
+            binary = true;
+        else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--query") == 0 && i + 1 < argc)
+            queries.push_back(argv[++i]);
+        else if(argv[i][0] == '-' || keyFile != NULL){
+            Usage();
+            return 2;
+        }
+        else
+            keyFile = argv[i];
+    }
+    if(keyFile == NULL){
+        Usage();
+        return 2;
+    }
+    if(threads < 1)
+        threads = 1;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    vector<Key> keys;
+    if(!Load_Keys("load", keyFile, binary, threads, keys))
+        return 1;
+    RedBlackTree<Key> tree;
+    chrono::steady_clock::time_point build = chrono::steady_clock::now();
+    tree.Build_From_Sorted(keys);
+    double buildMs = Ms_Since(build);
+    double ms = Ms_Since(start);
+    struct stat info;
+    double mb = stat(keyFile, &info) == 0 ? info.st_size / 1e6 : 0;
+    cout << "load build: " << keys.size() << " keys in " << buildMs << " ms, height "
+    << tree.Height() << endl;
+    cout << "load total: " << keys.size() << " keys in " << ms << " ms ("
+    << (ms > 0 ? keys.size() / ms * 1000.0 : 0) << " keys/s, "
+    << (ms > 0 ? mb / ms * 1000.0 : 0) << " MB/s)" << endl;
+    vector<Key>().swap(keys);
+
+    for(size_t q = 0; q < queries.size(); q++){
+        vector<Key> probes;
+        if(!Load_Keys("query", queries[q], binary, threads, probes))
+            return 1;
+        vector<bool> found;
+        chrono::steady_clock::time_point lookup = chrono::steady_clock::now();
+        tree.Find_Many(probes, found);
+        double lookupMs = Ms_Since(lookup);
+        long hits = count(found.begin(), found.end(), true);
+        cout << "query " << queries[q] << ": " << probes.size() << " keys, " << hits << " hits in "
+        << lookupMs << " ms (" << (lookupMs > 0 ? probes.size() / lookupMs / 1000.0 : 0) << " Mops/s)" << endl;
+    }
+    return 0;
+}
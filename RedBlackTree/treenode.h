@@ -4,27 +4,42 @@
 
 using namespace std;
 
+// Tree's node.  It's BalancedTreeNode without the stored height, and with the
+// tombstone mark in the top bit of the rank, so an int node is 32 bytes and
+// not 40.  A treap priority never needs that bit, it's never negative
 template <typename T>
 class TreeNode{
 public:
     TreeNode();
     ~TreeNode();
-    
+
+    // BalancedTree has no height to keep here, and walks the tree for one
+    static const bool KEEPS_HEIGHT = false;
+
     // accessors
-    T get_item() const;
+    const T& get_item() const;
+    TreeNode<T>* get_parent() const;
     TreeNode<T>* get_left() const;
     TreeNode<T>* get_right() const;
-    int get_level() const;
-    
+    // the treap priority, see Tree::Set_Randomized
+    int get_rank() const;
+    // deleted but still linked in, see BalancedTree::Set_Lazy_Delete
+    bool is_tombstone() const;
+
     // mutators
     void set_item(const T& new_item);
-    void set_level(const int& L);
+    void set_parent(TreeNode<T>* new_parent);
     void set_left(TreeNode<T>* new_left);
     void set_right(TreeNode<T>* new_right);
-    
+    // new_rank must be >= 0
+    void set_rank(const int& new_rank);
+    void set_tombstone(const bool& dead);
+
 private:
     T item;
-    int level;
+    unsigned rank : 31;
+    unsigned tombstone : 1;
+    TreeNode<T>* parent;
     TreeNode<T>* left;
     TreeNode<T>* right;
 };
@@ -33,9 +48,11 @@ private:
 // default constrctor, sets the pointers to NULL
 template <typename T>
 TreeNode<T>::TreeNode(){
+    parent = NULL;
     left = NULL;
     right = NULL;
-    level = 0;
+    rank = 0;
+    tombstone = 0;
 }
 
 // destructor.  I'll keep it like Node and not delete recursvely
@@ -47,10 +64,15 @@ TreeNode<T>::~TreeNode(){
 
 // accessor functions to get the parts of the node
 template <typename T>
-T TreeNode<T>::get_item() const{
+const T& TreeNode<T>::get_item() const{
     return item;
 }
 
+template <typename T>
+TreeNode<T>* TreeNode<T>::get_parent() const{
+    return parent;
+}
+
 template <typename T>
 TreeNode<T>* TreeNode<T>::get_left() const{
     return left;
@@ -62,8 +84,13 @@ TreeNode<T>* TreeNode<T>::get_right() const{
 }
 
 template <typename T>
-int TreeNode<T>::get_level() const{
-    return level;
+int TreeNode<T>::get_rank() const{
+    return (int)rank;
+}
+
+template <typename T>
+bool TreeNode<T>::is_tombstone() const{
+    return tombstone != 0;
 }
 
 // mutator functions to set the parts of the node
@@ -73,8 +100,8 @@ void TreeNode<T>::set_item(const T& new_item){
 }
 
 template <typename T>
-void TreeNode<T>::set_level(const int& L){
-    level = L;
+void TreeNode<T>::set_parent(TreeNode<T>* new_parent){
+    parent = new_parent;
 }
 
 template <typename T>
@@ -87,4 +114,14 @@ void TreeNode<T>::set_right(TreeNode<T>* new_right){
     right = new_right;
 }
 
+template <typename T>
+void TreeNode<T>::set_rank(const int& new_rank){
+    rank = (unsigned)new_rank;
+}
+
+template <typename T>
+void TreeNode<T>::set_tombstone(const bool& dead){
+    tombstone = dead ? 1 : 0;
+}
+
 #endif
@@ -0,0 +1,274 @@
+//
+//  treereplay.cpp
+//  RedBlackTree
+//
+//  Replays a trace written by a TraceRecorder against the containers.  Run as
+//      rbtree_replay [--container tree|rbtree|set|all] [--repeat n] tracefile
+//  Each container starts from the trace's preloaded items, then runs the
+//  recorded operations back to back, once for throughput and once timing
+//  every operation on its own for the latency percentiles.  Where the tree
+//  was rebuilt whole (a reset record, then its new contents as preloads) the
+//  container is built afresh from those, off the clock.  Answers that
+//  differ from the recorded ones are counted; any at all means the trace
+//  didn't start from the contents the preloads describe.
+//
+//  "set" is std::multiset: the trees keep duplicates, and a std::set would
+//  answer the trace differently.
+//
+
+#include "tree.h"
+#include "redblacktree.h"
+#include "treetrace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+
+using namespace std;
+
+// keeps the optimizer from throwing away lookups whose results we don't use
+static volatile long sink;
+
+// the containers behind the three calls the replay makes
+template <typename K>
+class TreeReplay{
+public:
+    static const char* Name(){ return "tree"; }
+    void Insert(const K& x){ tree.Insert(x); }
+    bool Delete(const K& x){ return tree.Delete(x); }
+    bool Find(const K& x) const{ return tree.Find(x); }
+private:
+    Tree<K> tree;
+};
+
+template <typename K>
+class RedBlackReplay{
+public:
+    static const char* Name(){ return "rbtree"; }
+    void Insert(const K& x){ tree.Red_Black_Insert(x); }
+    bool Delete(const K& x){ return tree.Red_Black_Delete(x); }
+    bool Find(const K& x) const{ return tree.Find(x); }
+private:
+    RedBlackTree<K> tree;
+};
+
+template <typename K>
+class SetReplay{
+public:
+    static const char* Name(){ return "set"; }
+    void Insert(const K& x){ items.insert(x); }
+    bool Delete(const K& x){
+        typename multiset<K>::iterator at = items.find(x);
+        if(at == items.end())
+            return false;
+        items.erase(at);
+        return true;
+    }
+    bool Find(const K& x) const{ return items.find(x) != items.end(); }
+private:
+    multiset<K> items;
+};
+
+// appends the middles of sorted[low, high) level by level, so inserting in
+// that order builds even the unbalanced Tree balanced
+template <typename K>
+static void Balanced_Order(const vector<K>& sorted, vector<K>& order){
+    vector<pair<size_t, size_t> > ranges(1, make_pair((size_t)0, sorted.size()));
+    for(size_t i = 0; i < ranges.size(); i++){
+        size_t low = ranges[i].first;
+        size_t high = ranges[i].second;
+        if(low >= high)
+            continue;
+        size_t mid = low + (high - low) / 2;
+        order.push_back(sorted[mid]);
+        ranges.push_back(make_pair(low, mid));
+        ranges.push_back(make_pair(mid + 1, high));
+    }
+}
+
+// the stretch of a trace between two resets: the contents it starts from, in
+// Balanced_Order, and the operations run on them
+template <typename K>
+struct Segment{
+    vector<K> preload;
+    vector<TraceRecord<K> > ops;
+};
+
+// runs one recorded operation, returning whether the answer matches
+template <typename K, typename Container>
+static inline bool Apply(Container& c, const TraceRecord<K>& r){
+    switch(r.Op()){
+        case TRACE_INSERT:
+            c.Insert(r.key);
+            return true;
+        case TRACE_DELETE:
+            return c.Delete(r.key) == r.Hit();
+        default:
+            return c.Find(r.key) == r.Hit();
+    }
+}
+
+static void Print_Percentiles(const char* container, const char* op, vector<double>& ns){
+    if(ns.empty())
+        return;
+    sort(ns.begin(), ns.end());
+    cout << container << " " << op << ": " << ns.size() << " ops, p50 " << ns[ns.size() / 2]
+    << " ns, p90 " << ns[ns.size() * 90 / 100] << " ns, p99 " << ns[ns.size() * 99 / 100]
+    << " ns, p99.9 " << ns[ns.size() * 999 / 1000] << " ns, max " << ns.back() << " ns" << endl;
+}
+
+template <typename K, typename Container>
+static void Replay(const vector<Segment<K> >& segments, int repeat){
+    const char* name = Container::Name();
+    long mismatches = 0;
+    size_t total = 0;
+    double best = 0;
+    for(int round = 0; round < repeat; round++){
+        long wrong = 0;
+        double ms = 0;
+        total = 0;
+        for(size_t s = 0; s < segments.size(); s++){
+            const Segment<K>& segment = segments[s];
+            Container c;
+            for(size_t i = 0; i < segment.preload.size(); i++)
+                c.Insert(segment.preload[i]);
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            for(size_t i = 0; i < segment.ops.size(); i++)
+                wrong += !Apply(c, segment.ops[i]);
+            ms += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            total += segment.ops.size();
+        }
+        if(round == 0 || ms < best)
+            best = ms;
+        mismatches = wrong;
+    }
+    sink = mismatches;
+    cout << name << " replay: " << total << " ops in " << best << " ms ("
+    << (best > 0 ? total / best / 1000.0 : 0) << " Mops/s), " << mismatches << " mismatches" << endl;
+
+    const char* opNames[3] = { "insert", "delete", "find" };
+    vector<double> ns[3];
+    long right = 0;
+    for(size_t s = 0; s < segments.size(); s++){
+        const Segment<K>& segment = segments[s];
+        Container c;
+        for(size_t i = 0; i < segment.preload.size(); i++)
+            c.Insert(segment.preload[i]);
+        for(size_t i = 0; i < segment.ops.size(); i++){
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            right += Apply(c, segment.ops[i]);
+            chrono::steady_clock::time_point end = chrono::steady_clock::now();
+            ns[segment.ops[i].Op()].push_back(chrono::duration<double, nano>(end - start).count());
+        }
+    }
+    sink = right;
+    for(int op = 0; op < 3; op++)
+        Print_Percentiles(name, opNames[op], ns[op]);
+}
+
+// Replay_Trace: every reset starts a new segment; preloads go to the segment
+// they're in, wherever in it they were recorded
+template <typename K>
+static int Replay_Trace(TraceReader& reader, const char* path, const char* container, int repeat){
+    vector<TraceRecord<K> > records;
+    if(!reader.Read_All(records)){
+        cerr << path << ": trace is cut short" << endl;
+        return 1;
+    }
+    vector<Segment<K> > segments(1);
+    vector<vector<K> > sorted(1);
+    long counts[3] = { 0, 0, 0 };
+    long preloaded = 0;
+    for(size_t i = 0; i < records.size(); i++){
+        if(records[i].Op() == TRACE_RESET){
+            segments.push_back(Segment<K>());
+            sorted.push_back(vector<K>());
+        }
+        else if(records[i].Preload()){
+            sorted.back().push_back(records[i].key);
+            preloaded++;
+        }
+        else{
+            segments.back().ops.push_back(records[i]);
+            counts[records[i].Op()]++;
+        }
+    }
+    for(size_t s = 0; s < segments.size(); s++){
+        sort(sorted[s].begin(), sorted[s].end());
+        segments[s].preload.reserve(sorted[s].size());
+        Balanced_Order(sorted[s], segments[s].preload);
+    }
+
+    double span = records.empty() ? 0 : (records.back().ns - records.front().ns) / 1e6;
+    cout << "trace: " << preloaded << " preloaded, " << segments.size() - 1 << " resets, "
+    << counts[TRACE_INSERT] << " inserts, " << counts[TRACE_DELETE] << " deletes, "
+    << counts[TRACE_FIND] << " finds over " << span << " ms as recorded" << endl;
+
+    bool all = strcmp(container, "all") == 0;
+    if(all || strcmp(container, "tree") == 0)
+        Replay<K, TreeReplay<K> >(segments, repeat);
+    if(all || strcmp(container, "rbtree") == 0)
+        Replay<K, RedBlackReplay<K> >(segments, repeat);
+    if(all || strcmp(container, "set") == 0)
+        Replay<K, SetReplay<K> >(segments, repeat);
+    return 0;
+}
+
+static void Usage(){
+    cerr << "usage: rbtree_replay [--container tree|rbtree|set|all] [--repeat n] tracefile" << endl;
+}
+
+int main(int argc, char* argv[]){
+    const char* container = "all";
+    int repeat = 3;
+    const char* path = NULL;
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "--container") == 0 && i + 1 < argc)
+            container = argv[++i];
+        else if(strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+            repeat = atoi(argv[++i]);
+        else if(argv[i][0] == '-' || path != NULL){
+            Usage();
+            return 2;
+        }
+        else
+            path = argv[i];
+    }
+    if(path == NULL || (strcmp(container, "all") != 0 && strcmp(container, "tree") != 0
+                        && strcmp(container, "rbtree") != 0 && strcmp(container, "set") != 0)){
+        Usage();
+        return 2;
+    }
+    if(repeat < 1)
+        repeat = 1;
+
+    TraceReader reader;
+    if(!reader.Open(path))
+        return 1;
+    int size = reader.Key_Size();
+    switch(reader.Key_Kind()){
+        case TRACE_SIGNED:
+            if(size == 4)
+                return Replay_Trace<int32_t>(reader, path, container, repeat);
+            if(size == 8)
+                return Replay_Trace<int64_t>(reader, path, container, repeat);
+            break;
+        case TRACE_UNSIGNED:
+            if(size == 4)
+                return Replay_Trace<uint32_t>(reader, path, container, repeat);
+            if(size == 8)
+                return Replay_Trace<uint64_t>(reader, path, container, repeat);
+            break;
+        case TRACE_FLOAT:
+            if(size == 4)
+                return Replay_Trace<float>(reader, path, container, repeat);
+            if(size == 8)
+                return Replay_Trace<double>(reader, path, container, repeat);
+            break;
+        default:
+            break;
+    }
+    cerr << path << ": can't replay " << size << " byte keys of kind '" << (char)reader.Key_Kind() << "'" << endl;
+    return 1;
+}
@@ -0,0 +1,220 @@
+//
+//  treestats.h
+//  RedBlackTree
+//
+//  Hot path counters for the trees.  They are only compiled in when
+//  RBTREE_STATS is defined (cmake -DRBTREE_STATS=ON); otherwise the
+//  RBTREE_STAT and RBTREE_TIME macros expand to nothing and the trees don't
+//  carry a stats member at all.
+//
+
+#ifndef TREESTATS_H
+#define TREESTATS_H
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+#ifdef RBTREE_STATS
+#define RBTREE_STAT(x) x
+#define RBTREE_TIME(histogram) LatencyTimer rbtree_latency_timer(histogram)
+#else
+#define RBTREE_STAT(x)
+#define RBTREE_TIME(histogram)
+#endif
+
+using namespace std;
+
+// Operation latencies in power of two nanosecond buckets: bucket b holds
+// samples in [2^(b-1), 2^b)
+class LatencyHistogram{
+public:
+    static const int BUCKETS = 40;
+
+    LatencyHistogram();
+
+    // adds one sample
+    void Record(uint64_t ns);
+
+    // number of samples recorded
+    uint64_t Count() const;
+
+    // number of samples in bucket b
+    uint64_t Bucket(int b) const;
+
+    // upper bound in ns of the bucket holding the p-th percentile (0 < p <= 100)
+    uint64_t Percentile(double p) const;
+
+    void Reset();
+
+    // prints count and p50/p90/p99/p99.9
+    void Print(ostream& out) const;
+
+private:
+    uint64_t buckets[BUCKETS];
+    uint64_t count;
+};
+
+// Times the scope it lives in into a histogram
+class LatencyTimer{
+public:
+    LatencyTimer(LatencyHistogram& h);
+    ~LatencyTimer();
+private:
+    LatencyHistogram& histogram;
+    chrono::steady_clock::time_point start;
+};
+
+// Counters for one tree.  A "lookup" is any root to leaf descent, including
+// the ones insert and delete do to find their position.
+struct TreeStats{
+    uint64_t lookups;
+    uint64_t comparisons;    // key comparisons made during lookups
+    uint64_t hops;           // nodes visited during lookups
+    uint64_t maxDepth;       // deepest descent seen
+    uint64_t leftRotations;
+    uint64_t rightRotations;
+    uint64_t insertRecolors; // color changes made by the red-black insert fixup
+    uint64_t deleteRecolors; // color changes made by the red-black delete fixup
+    uint64_t allocations;    // nodes allocated
+    uint64_t frees;
+    uint64_t filterRejects;  // finds the Set_Filter filter answered without a lookup
+    LatencyHistogram insertLatency;
+    LatencyHistogram deleteLatency;
+    LatencyHistogram findLatency;
+
+    TreeStats();
+
+    // starts a new descent
+    void Begin_Lookup();
+
+    // one node visited on the current descent
+    void Hop();
+
+    void Reset();
+
+    double Comparisons_Per_Lookup() const;
+    double Average_Depth() const;
+
+    void Print(ostream& out) const;
+
+private:
+    uint64_t curDepth;
+};
+
+
+inline LatencyHistogram::LatencyHistogram(){
+    Reset();
+}
+
+inline void LatencyHistogram::Record(uint64_t ns){
+    int b = 0;
+    while(ns != 0 && b < BUCKETS - 1){
+        ns >>= 1;
+        b++;
+    }
+    buckets[b]++;
+    count++;
+}
+
+inline uint64_t LatencyHistogram::Count() const{
+    return count;
+}
+
+inline uint64_t LatencyHistogram::Bucket(int b) const{
+    return buckets[b];
+}
+
+inline uint64_t LatencyHistogram::Percentile(double p) const{
+    if(count == 0)
+        return 0;
+    uint64_t wanted = (uint64_t)(count * p / 100.0);
+    if(wanted == 0)
+        wanted = 1;
+    uint64_t seen = 0;
+    for(int b = 0; b < BUCKETS; b++){
+        seen += buckets[b];
+        if(seen >= wanted)
+            return (uint64_t)1 << b;
+    }
+    return (uint64_t)1 << (BUCKETS - 1);
+}
+
+inline void LatencyHistogram::Reset(){
+    for(int b = 0; b < BUCKETS; b++)
+        buckets[b] = 0;
+    count = 0;
+}
+
+inline void LatencyHistogram::Print(ostream& out) const{
+    out << count << " ops, p50 < " << Percentile(50) << "ns, p90 < " << Percentile(90)
+    << "ns, p99 < " << Percentile(99) << "ns, p99.9 < " << Percentile(99.9) << "ns";
+}
+
+inline LatencyTimer::LatencyTimer(LatencyHistogram& h) : histogram(h){
+    start = chrono::steady_clock::now();
+}
+
+inline LatencyTimer::~LatencyTimer(){
+    histogram.Record((uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+}
+
+inline TreeStats::TreeStats(){
+    Reset();
+}
+
+inline void TreeStats::Begin_Lookup(){
+    lookups++;
+    curDepth = 0;
+}
+
+inline void TreeStats::Hop(){
+    hops++;
+    curDepth++;
+    if(curDepth > maxDepth)
+        maxDepth = curDepth;
+}
+
+inline void TreeStats::Reset(){
+    lookups = 0;
+    comparisons = 0;
+    hops = 0;
+    maxDepth = 0;
+    curDepth = 0;
+    leftRotations = 0;
+    rightRotations = 0;
+    insertRecolors = 0;
+    deleteRecolors = 0;
+    allocations = 0;
+    frees = 0;
+    filterRejects = 0;
+    insertLatency.Reset();
+    deleteLatency.Reset();
+    findLatency.Reset();
+}
+
+inline double TreeStats::Comparisons_Per_Lookup() const{
+    return lookups == 0 ? 0 : (double)comparisons / lookups;
+}
+
+inline double TreeStats::Average_Depth() const{
+    return lookups == 0 ? 0 : (double)hops / lookups;
+}
+
+inline void TreeStats::Print(ostream& out) const{
+    out << "lookups: " << lookups << ", comparisons/lookup: " << Comparisons_Per_Lookup()
+    << ", average depth: " << Average_Depth() << ", max depth: " << maxDepth << endl;
+    out << "rotations: " << leftRotations << " left, " << rightRotations << " right" << endl;
+    out << "recolors: " << insertRecolors << " insert fixup, " << deleteRecolors << " delete fixup" << endl;
+    out << "nodes: " << allocations << " allocated, " << frees << " freed" << endl;
+    out << "filter: " << filterRejects << " finds rejected" << endl;
+    out << "insert latency: ";
+    insertLatency.Print(out);
+    out << endl << "delete latency: ";
+    deleteLatency.Print(out);
+    out << endl << "find latency: ";
+    findLatency.Print(out);
+    out << endl;
+}
+
+#endif
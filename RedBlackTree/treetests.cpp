@@ -0,0 +1,1586 @@
+//
+//  treetests.cpp
+//  RedBlackTree
+//
+//  Randomized tests.  Each one runs a container and a std::multiset through
+//  the same random operations and checks that every answer and the final
+//  contents agree, with the container's own Verify() after the steps in
+//  between.  Run as
+//      rbtree_tests [test|all] [seed]
+//  It exits non-zero if anything failed; CTest runs each test on its own.
+//
+
+#include "tree.h"
+#include "redblacktree.h"
+#include "cowtree.h"
+#include "indexedtree.h"
+#include "lockfreeset.h"
+#include "shardedtree.h"
+#include "smalltree.h"
+#include "stringtree.h"
+#include <atomic>
+#include <cmath>
+#include <iterator>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <set>
+#include <thread>
+
+using namespace std;
+
+static long failures = 0;
+
+// counts and reports a failed check.  Returns "ok", so a loop can stop at
+// the first failure instead of repeating it thousands of times
+static bool Check(bool ok, const char* what, const char* file, int line){
+    if(!ok){
+        failures++;
+        cerr << file << ":" << line << ": failed: " << what << endl;
+    }
+    return ok;
+}
+
+#define CHECK(cond) Check((cond), #cond, __FILE__, __LINE__)
+
+// deletes one copy of x from the model, the way the trees do.  Returns
+// whether there was one
+template <typename K>
+static bool Erase_One(multiset<K>& model, const K& x){
+    typename multiset<K>::iterator at = model.find(x);
+    if(at == model.end())
+        return false;
+    model.erase(at);
+    return true;
+}
+
+// whether to Verify after this step: every one while the tree is small, then
+// less often as it grows, so the checking stays about linear overall
+static bool Verify_Now(int step, long size){
+    return step % (1 + size / 256) == 0;
+}
+
+// whether the container holds exactly the model's items, in order
+template <typename Container, typename K>
+static bool Same_Contents(const Container& c, const multiset<K>& model){
+    vector<K> items;
+    c.Dump_To_Vector(items);
+    return items == vector<K>(model.begin(), model.end());
+}
+
+// inserts, deletes and finds over keys in [0, range), checking every answer
+static bool Random_Red_Black(RedBlackTree<int>& tree, multiset<int>& model, int range, int steps, mt19937& rng){
+    for(int step = 0; step < steps; step++){
+        int x = (int)(rng() % range);
+        unsigned what = rng() % 20;
+        if(what < 9){
+            if(what < 3)
+                tree.Red_Black_Insert_Hinted(x);
+            else
+                tree.Red_Black_Insert(x);
+            model.insert(x);
+        }
+        else if(what < 16){
+            if(!CHECK(tree.Red_Black_Delete(x) == Erase_One(model, x)))
+                return false;
+        }
+        else if(!CHECK(tree.Find(x) == (model.count(x) > 0)))
+            return false;
+        if(!CHECK(tree.Size() == (long)model.size()))
+            return false;
+        if(Verify_Now(step, tree.Size()) && !CHECK(tree.Verify()))
+            return false;
+    }
+    return CHECK(tree.Verify()) && CHECK(Same_Contents(tree, model));
+}
+
+// the plain red-black tree: a few duplicates per key, many, and next to none
+static void Test_Red_Black(unsigned seed){
+    mt19937 rng(seed);
+    const int ranges[] = { 8, 200, 1 << 20 };
+    for(int r = 0; r < 3; r++){
+        RedBlackTree<int> tree;
+        multiset<int> model;
+        if(!Random_Red_Black(tree, model, ranges[r], 20000, rng))
+            return;
+
+        // copies are deep: they start out equal and then go their own way
+        RedBlackTree<int> copy(tree);
+        RedBlackTree<int> assigned;
+        assigned.Red_Black_Insert(-1);
+        assigned = tree;
+        CHECK(copy.Verify() && Same_Contents(copy, model));
+        CHECK(assigned.Verify() && Same_Contents(assigned, model));
+        multiset<int> copyModel = model;
+        if(!Random_Red_Black(copy, copyModel, ranges[r], 2000, rng))
+            return;
+        CHECK(Same_Contents(tree, model));
+
+        // and empties out again
+        vector<int> items(model.begin(), model.end());
+        shuffle(items.begin(), items.end(), rng);
+        for(size_t i = 0; i < items.size(); i++){
+            if(!CHECK(tree.Red_Black_Delete(items[i])))
+                return;
+        }
+        CHECK(tree.Verify() && tree.Is_Empty() && tree.Height() == 0);
+        CHECK(!tree.Red_Black_Delete(0) && !tree.Find(0));
+    }
+}
+
+// the smallest height a tree of n nodes can have
+static int Min_Height(long n){
+    int height = 0;
+    while(((long)1 << height) - 1 < n)
+        height++;
+    return height;
+}
+
+// the item at the root, which Visit_Level_Order hands over first
+template <typename K, typename Policy, typename NodeType>
+static K Root_Item(const BalancedTree<K, Policy, NodeType>& tree){
+    K item = K();
+    bool first = true;
+    tree.Visit_Level_Order([&item, &first](const K& x, int){
+        if(first)
+            item = x;
+        first = false;
+    });
+    return item;
+}
+
+// inserts, deletes and finds on the unbalanced tree, plain or a treap, with
+// now and then the root taken out on purpose
+static bool Random_Tree(Tree<int>& tree, multiset<int>& model, int range, int steps, mt19937& rng){
+    for(int step = 0; step < steps; step++){
+        int x = (int)(rng() % range);
+        unsigned what = rng() % 20;
+        if(what < 9){
+            tree.Insert(x);
+            model.insert(x);
+        }
+        else if(what < 15){
+            if(!CHECK(tree.Delete(x) == Erase_One(model, x)))
+                return false;
+        }
+        else if(what < 16 && !model.empty()){
+            int top = Root_Item(tree);
+            if(!CHECK(tree.Delete(top) && Erase_One(model, top)))
+                return false;
+        }
+        else if(!CHECK(tree.Find(x) == (model.count(x) > 0)))
+            return false;
+        if(Verify_Now(step, (long)model.size()) && !(CHECK(tree.Verify()) && CHECK(Same_Contents(tree, model))))
+            return false;
+    }
+    return CHECK(tree.Verify()) && CHECK(Same_Contents(tree, model));
+}
+
+// Tree, plain and randomized: turning the treap on over a populated tree
+// has to rebuild it into one, copies keep the mode, and sorted input mustn't
+// make a treap any deeper than a random one
+static void Test_Tree(unsigned seed){
+    mt19937 rng(seed);
+    const int ranges[] = { 8, 200, 1 << 20 };
+    for(int r = 0; r < 3; r++){
+        Tree<int> tree;
+        multiset<int> model;
+        if(!Random_Tree(tree, model, ranges[r], 5000, rng))
+            return;
+        tree.Set_Randomized(true);
+        CHECK(tree.Is_Randomized());
+        if(!CHECK(tree.Verify()) || !CHECK(Same_Contents(tree, model)))
+            return;
+        if(!Random_Tree(tree, model, ranges[r], 20000, rng))
+            return;
+
+        Tree<int> copy(tree);
+        Tree<int> assigned;
+        assigned.Insert(-1);
+        assigned = tree;
+        CHECK(copy.Is_Randomized() && copy.Verify() && Same_Contents(copy, model));
+        CHECK(assigned.Is_Randomized() && assigned.Verify() && Same_Contents(assigned, model));
+        multiset<int> copyModel = model;
+        if(!Random_Tree(copy, copyModel, ranges[r], 2000, rng))
+            return;
+        CHECK(Same_Contents(tree, model));
+
+        // off again, the shape stays and the tree carries on unbalanced
+        tree.Set_Randomized(false);
+        if(!Random_Tree(tree, model, ranges[r], 2000, rng))
+            return;
+
+        // the root goes until nothing's left
+        while(!model.empty()){
+            int top = Root_Item(tree);
+            if(!CHECK(tree.Delete(top) && Erase_One(model, top)))
+                return;
+        }
+        CHECK(tree.Verify() && tree.Height() == 0 && !tree.Delete(0));
+    }
+
+    Tree<int> sorted;
+    sorted.Set_Randomized(true);
+    const int n = 1 << 15;
+    for(int i = 0; i < n; i++)
+        sorted.Insert(i);
+    CHECK(sorted.Verify());
+    CHECK(sorted.Height() <= 4 * Min_Height(n));
+    for(int i = 0; i < n; i += 2)
+        sorted.Delete(i);
+    CHECK(sorted.Verify());
+    CHECK(sorted.Height() <= 4 * Min_Height(n));
+}
+
+// relaxed mode: the same random operations, with a few units of
+// Rebalance_Step now and then and pops from both ends, while Verify lets red
+// sit over red only as long as fixups are pending.  Draining the backlog,
+// by steps or by turning the mode off, has to leave a strict red-black tree
+static void Test_Relaxed(unsigned seed){
+    mt19937 rng(seed);
+    const int ranges[] = { 16, 500, 1 << 20 };
+    for(int r = 0; r < 3; r++){
+        RedBlackTree<int> tree;
+        multiset<int> model;
+        tree.Set_Relaxed(true);
+        for(int step = 0; step < 20000; step++){
+            int x = (int)(rng() % ranges[r]);
+            unsigned what = rng() % 20;
+            bool ok = true;
+            if(what < 10){
+                tree.Red_Black_Insert(x);
+                model.insert(x);
+            }
+            else if(what < 15)
+                ok = tree.Red_Black_Delete(x) == Erase_One(model, x);
+            else if(what < 18)
+                ok = tree.Find(x) == (model.count(x) > 0);
+            else{
+                int got = 0;
+                bool popped = what == 18 ? tree.Pop_Min(got) : tree.Pop_Max(got);
+                ok = popped == !model.empty();
+                if(popped && ok){
+                    ok = got == (what == 18 ? *model.begin() : *model.rbegin());
+                    Erase_One(model, got);
+                }
+            }
+            if(rng() % 4 == 0)
+                tree.Rebalance_Step((int)(rng() % 4));
+            if(!CHECK(ok) || !CHECK(tree.Size() == (long)model.size()))
+                return;
+            if(Verify_Now(step, tree.Size()) && !CHECK(tree.Verify()))
+                return;
+        }
+        CHECK(tree.Verify() && Same_Contents(tree, model));
+        int pending = tree.Pending_Rebalance();
+        int steps = 0;
+        while(tree.Rebalance_Step(1) > 0 && steps <= 4 * pending + 64)
+            steps++;
+        CHECK(tree.Pending_Rebalance() == 0);
+        CHECK(tree.Verify() && Same_Contents(tree, model));
+        tree.Set_Relaxed(false);
+        if(!Random_Red_Black(tree, model, ranges[r], 2000, rng))
+            return;
+    }
+
+    // a sorted backlog with no steps at all is the worst case; turning the
+    // mode off has to do all of it
+    RedBlackTree<int> tree;
+    multiset<int> model;
+    tree.Set_Relaxed(true);
+    for(int i = 0; i < 5000; i++){
+        tree.Red_Black_Insert(i);
+        model.insert(i);
+        if(i % 3 == 0){
+            tree.Red_Black_Delete(i / 2);
+            Erase_One(model, i / 2);
+        }
+    }
+    CHECK(tree.Verify());
+    tree.Set_Relaxed(false);
+    CHECK(!tree.Is_Relaxed() && tree.Pending_Rebalance() == 0);
+    CHECK(tree.Verify() && Same_Contents(tree, model));
+    CHECK(tree.Height() <= 2 * 13); // 2 log2(n + 1) for n < 8192
+}
+
+// lazy deletes: deletes leave tombstones that a re-insert of the same item
+// brings back, and Compact, whether the ratio calls for it or it's called
+// directly, rebuilds a perfectly balanced tree in an arena that later
+// inserts and deletes have to work around.  Then the same with relaxed mode
+// on as well, whose deletes win, and Build_From_Sorted with duplicates
+static void Test_Lazy(unsigned seed){
+    mt19937 rng(seed);
+    const int ranges[] = { 16, 500, 1 << 20 };
+    const double ratios[] = { 0.05, 0.25, 1.0 };
+    for(int r = 0; r < 3; r++){
+        RedBlackTree<int> tree;
+        multiset<int> model;
+        tree.Set_Lazy_Delete(true, ratios[r]);
+        for(int step = 0; step < 20000; step++){
+            int x = (int)(rng() % ranges[r]);
+            unsigned what = rng() % 40;
+            bool ok = true;
+            if(what < 18){
+                tree.Red_Black_Insert(x);
+                model.insert(x);
+            }
+            else if(what < 32)
+                ok = tree.Red_Black_Delete(x) == Erase_One(model, x);
+            else if(what < 39)
+                ok = tree.Find(x) == (model.count(x) > 0);
+            else{
+                tree.Compact();
+                ok = tree.Height() == Min_Height(tree.Size());
+            }
+            if(!CHECK(ok) || !CHECK(tree.Size() == (long)model.size()))
+                return;
+            if(Verify_Now(step, tree.Size()) && !CHECK(tree.Verify()))
+                return;
+        }
+        CHECK(tree.Verify() && Same_Contents(tree, model));
+        tree.Set_Lazy_Delete(false); // compacts, so no tombstone may be left
+        CHECK(tree.Verify() && Same_Contents(tree, model));
+        CHECK(tree.Height() == Min_Height(tree.Size()));
+        if(!Random_Red_Black(tree, model, ranges[r], 2000, rng))
+            return;
+
+        tree.Set_Lazy_Delete(true, ratios[r]);
+        tree.Set_Relaxed(true);
+        for(int step = 0; step < 5000; step++){
+            int x = (int)(rng() % ranges[r]);
+            bool ok = true;
+            if(rng() % 2 == 0){
+                tree.Red_Black_Insert(x);
+                model.insert(x);
+            }
+            else
+                ok = tree.Red_Black_Delete(x) == Erase_One(model, x);
+            if(rng() % 8 == 0)
+                tree.Rebalance_Step(2);
+            if(!CHECK(ok) || (Verify_Now(step, tree.Size()) && !CHECK(tree.Verify())))
+                return;
+        }
+        tree.Set_Relaxed(false);
+        tree.Set_Lazy_Delete(false);
+        CHECK(tree.Verify() && Same_Contents(tree, model));
+    }
+
+    for(int n = 0; n < 300; n += 1 + n / 8){
+        vector<int> items;
+        for(int i = 0; i < n; i++)
+            items.push_back(i / 3);
+        RedBlackTree<int> tree;
+        tree.Red_Black_Insert(-1);
+        tree.Build_From_Sorted(items);
+        multiset<int> model(items.begin(), items.end());
+        CHECK(tree.Verify() && Same_Contents(tree, model));
+        CHECK(tree.Height() == Min_Height(n));
+        if(!Random_Red_Black(tree, model, n + 1, 200, rng))
+            return;
+    }
+}
+
+// an int that keeps count of how many of it exist, so a test can tell
+// whether nodes were really freed
+struct Tracked{
+    static atomic<long> alive;
+    int key;
+
+    Tracked(int k = 0) : key(k){ alive++; }
+    Tracked(const Tracked& other) : key(other.key){ alive++; }
+    Tracked& operator=(const Tracked& other){ key = other.key; return *this; }
+    ~Tracked(){ alive--; }
+    bool operator<(const Tracked& other) const{ return key < other.key; }
+    bool operator>=(const Tracked& other) const{ return key >= other.key; }
+    bool operator==(const Tracked& other) const{ return key == other.key; }
+};
+
+atomic<long> Tracked::alive(0);
+
+// Expire_Before as a sliding window: new items arrive above the cutoff,
+// random ones get deleted, and the cutoff moves up by steps that drop a few
+// items, freed inline, or thousands, handed to the BackgroundReclaimer.
+// Each mode of the tree in turn: plain, lazy deletes with tombstones in the
+// dropped part, relaxed with a backlog, a filter, and nodes in a Compact
+// arena
+static void Test_Expire(unsigned seed){
+    mt19937 rng(seed);
+    for(int mode = 0; mode < 5; mode++){
+        RedBlackTree<int> tree;
+        multiset<int> model;
+        if(mode == 1)
+            tree.Set_Lazy_Delete(true, 0.5);
+        else if(mode == 2)
+            tree.Set_Relaxed(true);
+        else if(mode == 3)
+            tree.Set_Filter(true);
+        int cutoff = 0;
+        int top = 0; // items arrive in [cutoff, top)
+        for(int round = 0; round < 60; round++){
+            int arrivals = round % 3 == 0 ? 3000 : 100;
+            top += arrivals;
+            for(int i = 0; i < arrivals; i++){
+                int x = cutoff + (int)(rng() % (top - cutoff));
+                tree.Red_Black_Insert(x);
+                model.insert(x);
+            }
+            for(int i = 0; i < arrivals / 4; i++){
+                int x = cutoff + (int)(rng() % (top - cutoff));
+                if(!CHECK(tree.Red_Black_Delete(x) == Erase_One(model, x)))
+                    return;
+            }
+            if(mode == 4 && round % 10 == 0)
+                tree.Compact();
+            cutoff += round % 3 == 1 ? 3000 : (int)(rng() % 40);
+            if(cutoff > top)
+                cutoff = top;
+            long expected = (long)distance(model.begin(), model.lower_bound(cutoff));
+            model.erase(model.begin(), model.lower_bound(cutoff));
+            if(!CHECK(tree.Expire_Before(cutoff) == expected) || !CHECK(tree.Verify()))
+                return;
+            int first = 0;
+            if(!CHECK(tree.Size() == (long)model.size())
+               || !CHECK(tree.Min(first) == !model.empty())
+               || !CHECK(model.empty() || first == *model.begin()))
+                return;
+        }
+        CHECK(Same_Contents(tree, model));
+        CHECK(tree.Expire_Before(top + 1) == (long)model.size());
+        CHECK(tree.Verify() && tree.Is_Empty());
+    }
+
+    // the dropped nodes must all be freed once the reclaimer has caught up,
+    // big drops and small, and nothing that stays
+    BackgroundReclaimer::Global().Drain();
+    long before = Tracked::alive;
+    {
+        RedBlackTree<Tracked> tree;
+        for(int i = 0; i < 20000; i++)
+            tree.Red_Black_Insert(Tracked(i));
+        CHECK(tree.Expire_Before(Tracked(100)) == 100);
+        CHECK(tree.Expire_Before(Tracked(15000)) == 14900);
+        BackgroundReclaimer::Global().Drain();
+        CHECK(Tracked::alive - before == tree.Size());
+        CHECK(tree.Verify());
+    }
+    CHECK(Tracked::alive == before);
+}
+
+// runs work(t) on threads 0..threads-1 and waits for all of them
+template <typename Work>
+static void Run_Threads(int threads, Work work){
+    vector<thread> pool;
+    for(int t = 0; t < threads; t++)
+        pool.push_back(thread(work, t));
+    for(size_t t = 0; t < pool.size(); t++)
+        pool[t].join();
+}
+
+// LockFreeSet from four threads at once.  Each thread owns the keys that are
+// its number mod 4 and checks every answer on them against its own model;
+// all of them also fight over a small shared range, where only the net
+// count of successful inserts and deletes per key can be checked, against
+// what's left at the end
+static void Test_Lock_Free(unsigned seed){
+    const int threads = 4;
+    const int owned = 512 * threads;
+    const int shared = 16;
+    const int steps = 20000;
+    LockFreeSet<int> lockFree;
+    atomic<int> net[shared];
+    for(int k = 0; k < shared; k++)
+        net[k].store(0);
+    atomic<long> wrong(0);
+    vector<set<int> > models(threads);
+    Run_Threads(threads, [&](int t){
+        mt19937 rng(seed + t);
+        set<int>& model = models[t];
+        for(int step = 0; step < steps; step++){
+            unsigned what = rng() % 10;
+            if(rng() % 4 == 0){ // a shared key, stored past the owned ones
+                int k = (int)(rng() % shared);
+                if(what < 4)
+                    net[k] += lockFree.Red_Black_Insert(owned + k);
+                else if(what < 8)
+                    net[k] -= lockFree.Red_Black_Delete(owned + k);
+                else
+                    lockFree.Find(owned + k);
+                continue;
+            }
+            int x = (int)(rng() % (owned / threads)) * threads + t;
+            bool ok;
+            if(what < 4)
+                ok = lockFree.Red_Black_Insert(x) == model.insert(x).second;
+            else if(what < 8)
+                ok = lockFree.Red_Black_Delete(x) == (model.erase(x) > 0);
+            else
+                ok = lockFree.Find(x) == (model.count(x) > 0);
+            if(!ok)
+                wrong++;
+        }
+    });
+    CHECK(wrong == 0);
+
+    vector<int> items;
+    lockFree.Dump_To_Vector(items);
+    set<int> expected;
+    for(int t = 0; t < threads; t++)
+        expected.insert(models[t].begin(), models[t].end());
+    for(int k = 0; k < shared; k++){
+        CHECK(net[k] == 0 || net[k] == 1);
+        if(net[k] == 1)
+            expected.insert(owned + k);
+    }
+    CHECK(items == vector<int>(expected.begin(), expected.end()));
+}
+
+// a key that counts how many times a LockFreeSet node holding it has been
+// destroyed.  The set assigns the item into each node it makes, and only
+// copies made that way count, not the caller's or Dump_To_Vector's
+struct Counted{
+    static atomic<int> freed[2];
+    int key;
+    bool inNode;
+
+    Counted(int k = 0) : key(k), inNode(false){}
+    Counted(const Counted& other) : key(other.key), inNode(false){}
+    Counted& operator=(const Counted& other){
+        key = other.key;
+        inNode = true;
+        return *this;
+    }
+    ~Counted(){
+        if(inNode && key >= 0 && key < 2)
+            freed[key]++;
+    }
+    bool operator<(const Counted& other) const{ return key < other.key; }
+    bool operator==(const Counted& other) const{ return key == other.key; }
+};
+
+atomic<int> Counted::freed[2];
+
+// a node deleted while another thread is pinned must outlive that pin, and
+// must be freed once nobody is pinned any more.  The reader pins and holds
+// still; meanwhile the writer deletes key 0, churns through thousands more
+// nodes so the epoch gets every chance to move on, and checks key 0's node
+// is still there.  Once the reader lets go, more churn must free it
+static void Test_Reclaim(unsigned){
+    EpochDomain::Global().Drain(); // whatever the tests before left retired
+    for(int k = 0; k < 2; k++)
+        Counted::freed[k].store(0);
+    LockFreeSet<Counted> lockFree;
+    atomic<int> stage(0); // 1: the reader is pinned, 2: it may let go, 3: it has
+    Run_Threads(2, [&](int t){
+        if(t == 0){
+            EpochGuard guard;
+            stage = 1;
+            while(stage != 2)
+                this_thread::yield();
+        }
+        else{
+            while(stage != 1)
+                this_thread::yield();
+            lockFree.Red_Black_Insert(Counted(0));
+            CHECK(lockFree.Red_Black_Delete(Counted(0)));
+            for(int i = 0; i < 20000; i++){
+                lockFree.Red_Black_Insert(Counted(1000 + i % 64));
+                lockFree.Red_Black_Delete(Counted(1000 + i % 64));
+            }
+            CHECK(Counted::freed[0] == 0);
+            stage = 2;
+        }
+    });
+    for(int i = 0; i < 20000 && Counted::freed[0] == 0; i++){
+        lockFree.Red_Black_Insert(Counted(1000 + i % 64));
+        lockFree.Red_Black_Delete(Counted(1000 + i % 64));
+    }
+    CHECK(Counted::freed[0] == 1);
+}
+
+// checks Visit_Level_Order and Depth_Histogram against each other and the
+// model: every item once, the depths never going back up, each level left
+// to right in order, as many levels as the height and no level more than
+// twice as full as the one above it
+template <typename Container>
+static bool Same_Levels(const Container& tree, const multiset<int>& model){
+    multiset<int> seen;
+    vector<int> counts;
+    int depth = 0;
+    int last = 0;
+    bool ordered = true;
+    tree.Visit_Level_Order([&](const int& x, int d){
+        if(d < depth || d > depth + 1)
+            ordered = false;
+        else if(d == depth && x < last)
+            ordered = false;
+        if(d > (int)counts.size())
+            counts.resize(d, 0);
+        counts[d - 1]++;
+        depth = d;
+        last = x;
+        seen.insert(x);
+    });
+    vector<int> histogram;
+    tree.Depth_Histogram(histogram);
+    if(!CHECK(ordered) || !CHECK(seen == model) || !CHECK(histogram == counts))
+        return false;
+    if(!CHECK((int)histogram.size() == tree.Height()))
+        return false;
+    for(size_t i = 0; i < histogram.size(); i++){
+        if(!CHECK(histogram[i] <= (i == 0 ? 1 : 2 * histogram[i - 1])))
+            return false;
+    }
+    return true;
+}
+
+// level order on a red-black tree and a treap as they grow and shrink, and
+// on the empty tree
+static void Test_Level_Order(unsigned seed){
+    mt19937 rng(seed);
+    const int ranges[] = { 8, 200, 1 << 20 };
+    for(int r = 0; r < 3; r++){
+        RedBlackTree<int> tree;
+        Tree<int> treap;
+        treap.Set_Randomized(true);
+        multiset<int> model;
+        if(!Same_Levels(tree, model) || !Same_Levels(treap, model))
+            return;
+        for(int step = 0; step < 6000; step++){
+            int x = (int)(rng() % ranges[r]);
+            if(rng() % 3 != 0){
+                tree.Red_Black_Insert(x);
+                treap.Insert(x);
+                model.insert(x);
+            }
+            else{
+                bool had = Erase_One(model, x);
+                if(!CHECK(tree.Red_Black_Delete(x) == had) || !CHECK(treap.Delete(x) == had))
+                    return;
+            }
+            if(Verify_Now(step, (long)model.size()) && !(Same_Levels(tree, model) && Same_Levels(treap, model)))
+                return;
+        }
+        if(Same_Levels(tree, model))
+            Same_Levels(treap, model);
+    }
+}
+
+// the same random operations through BalancedTree's own interface, with
+// the hinted insert, Access and pops from both ends mixed in
+template <typename Container>
+static bool Random_Balanced(Container& tree, multiset<int>& model, int range, int steps, mt19937& rng){
+    for(int step = 0; step < steps; step++){
+        int x = (int)(rng() % range);
+        unsigned what = rng() % 20;
+        bool ok = true;
+        if(what < 9){
+            if(what < 3)
+                tree.Insert_Hinted(x);
+            else
+                tree.Insert(x);
+            model.insert(x);
+        }
+        else if(what < 15)
+            ok = tree.Delete(x) == Erase_One(model, x);
+        else if(what < 17)
+            ok = tree.Find(x) == (model.count(x) > 0);
+        else if(what < 19)
+            ok = tree.Access(x) == (model.count(x) > 0);
+        else{
+            int got = 0;
+            bool low = rng() % 2 == 0;
+            bool popped = low ? tree.Pop_Min(got) : tree.Pop_Max(got);
+            ok = popped == !model.empty();
+            if(popped && ok){
+                ok = got == (low ? *model.begin() : *model.rbegin());
+                Erase_One(model, got);
+            }
+        }
+        if(!CHECK(ok) || !CHECK(tree.Size() == (long)model.size()))
+            return false;
+        if(Verify_Now(step, tree.Size()) && !CHECK(tree.Verify()))
+            return false;
+    }
+    return CHECK(tree.Verify()) && CHECK(Same_Contents(tree, model));
+}
+
+// one policy through random operations at three key ranges, copies and
+// assignment, and then emptied out again.  Sorted input, the worst case for
+// an unbalanced tree, mustn't make it deeper than "maxHeight" says for n
+template <typename Container>
+static void Test_Policy(mt19937& rng, int (*maxHeight)(long n)){
+    const int ranges[] = { 8, 200, 1 << 20 };
+    for(int r = 0; r < 3; r++){
+        Container tree;
+        multiset<int> model;
+        if(!Random_Balanced(tree, model, ranges[r], 20000, rng))
+            return;
+        if(!CHECK(tree.Height() <= maxHeight(tree.Size())))
+            return;
+
+        Container copy(tree);
+        Container assigned;
+        assigned.Insert(-1);
+        assigned = tree;
+        CHECK(copy.Verify() && Same_Contents(copy, model));
+        CHECK(assigned.Verify() && Same_Contents(assigned, model));
+        multiset<int> copyModel = model;
+        if(!Random_Balanced(copy, copyModel, ranges[r], 2000, rng))
+            return;
+        CHECK(Same_Contents(tree, model));
+
+        vector<int> items(model.begin(), model.end());
+        shuffle(items.begin(), items.end(), rng);
+        for(size_t i = 0; i < items.size(); i++){
+            if(!CHECK(tree.Delete(items[i])))
+                return;
+            if(Verify_Now((int)i, tree.Size()) && !CHECK(tree.Verify()))
+                return;
+        }
+        CHECK(tree.Verify() && tree.Is_Empty() && tree.Height() == 0);
+    }
+
+    Container sorted;
+    const int n = 1 << 12;
+    for(int i = 0; i < n; i++)
+        sorted.Insert(i);
+    CHECK(sorted.Verify() && sorted.Height() <= maxHeight(n));
+    for(int i = 0; i < n; i += 2)
+        sorted.Delete(i);
+    CHECK(sorted.Verify() && sorted.Height() <= maxHeight(n / 2));
+}
+
+// 1.44 log2(n + 2), AVL's worst case
+static int AVL_Height(long n){
+    return (int)(1.4405 * log2((double)n + 2));
+}
+
+// 2 log2(n + 1), red-black's, which bounds WAVL's too
+static int Red_Black_Height(long n){
+    return 2 * Min_Height(n);
+}
+
+// a treap is only balanced in expectation, so this is a loose bound
+static int Treap_Height(long n){
+    return 4 * Min_Height(n);
+}
+
+static int Any_Height(long n){
+    return (int)n;
+}
+
+// every policy behind BalancedTree against the model
+static void Test_Policies(unsigned seed){
+    mt19937 rng(seed);
+    Test_Policy<RBTree<int> >(rng, Red_Black_Height);
+    Test_Policy<AVLTree<int> >(rng, AVL_Height);
+    Test_Policy<WAVLTree<int> >(rng, Red_Black_Height);
+    Test_Policy<TreapTree<int> >(rng, Treap_Height);
+    Test_Policy<UnbalancedTree<int> >(rng, Any_Height);
+}
+
+// splay: the usual random operations, and then Access has to bring what it
+// finds to the root, or on a miss the last node it looked at, which is the
+// model's neighbour on one side.  A few hot keys asked for over and over
+// must stay near the top, and Find must never move anything
+static void Test_Splay(unsigned seed){
+    mt19937 rng(seed);
+    Test_Policy<SplayTree<int> >(rng, Any_Height);
+
+    SplayTree<int> tree;
+    multiset<int> model;
+    if(!Random_Balanced(tree, model, 1 << 12, 5000, rng))
+        return;
+    for(int step = 0; step < 5000; step++){
+        int x = (int)(rng() % (1 << 12));
+        bool found = tree.Access(x);
+        if(!CHECK(found == (model.count(x) > 0)))
+            return;
+        int top = Root_Item(tree);
+        if(found && !CHECK(top == x))
+            return;
+        if(!found && !model.empty()){
+            multiset<int>::iterator above = model.lower_bound(x);
+            bool neighbour = (above != model.end() && top == *above)
+                || (above != model.begin() && top == *prev(above));
+            if(!CHECK(neighbour))
+                return;
+        }
+        int before = top;
+        tree.Find((int)(rng() % (1 << 12)));
+        if(!CHECK(Root_Item(tree) == before))
+            return;
+        if(Verify_Now(step, tree.Size()) && !CHECK(tree.Verify()))
+            return;
+    }
+
+    // eight hot keys get nine accesses in ten
+    vector<int> items(model.begin(), model.end());
+    vector<int> hot;
+    for(int i = 0; i < 8 && !items.empty(); i++)
+        hot.push_back(items[rng() % items.size()]);
+    for(int step = 0; step < 20000 && !hot.empty(); step++){
+        int x = rng() % 10 != 0 ? hot[rng() % hot.size()] : (int)(rng() % (1 << 12));
+        CHECK(tree.Access(x) == (model.count(x) > 0));
+    }
+    for(size_t i = 0; i < hot.size(); i++){
+        int depth = 0;
+        tree.Visit_Level_Order([&](const int& x, int d){
+            if(x == hot[i] && depth == 0)
+                depth = d;
+        });
+        CHECK(depth > 0 && depth <= 3 * (int)hot.size());
+    }
+    CHECK(tree.Verify() && Same_Contents(tree, model));
+}
+
+// ShardedTree, first on one thread with splits coming every few hundred
+// writes, checking every answer; then four writers on keys of their own,
+// each checking its answers against its own model, while a fifth keeps
+// calling Verify and Size as shards split under it
+static void Test_Sharded(unsigned seed){
+    mt19937 rng(seed);
+    const int ranges[] = { 64, 5000, 1 << 20 };
+    for(int r = 0; r < 3; r++){
+        ShardedTree<int> tree(32, 256, 16);
+        multiset<int> model;
+        for(int step = 0; step < 30000; step++){
+            int x = (int)(rng() % ranges[r]);
+            unsigned what = rng() % 20;
+            bool ok;
+            if(what < 10){
+                tree.Red_Black_Insert(x);
+                model.insert(x);
+                ok = true;
+            }
+            else if(what < 16)
+                ok = tree.Red_Black_Delete(x) == Erase_One(model, x);
+            else
+                ok = tree.Find(x) == (model.count(x) > 0);
+            if(!CHECK(ok) || !CHECK(tree.Size() == (long)model.size()))
+                return;
+            if(Verify_Now(step, tree.Size()) && !CHECK(tree.Verify()))
+                return;
+        }
+        CHECK(tree.Verify() && Same_Contents(tree, model));
+        if(r > 0)
+            CHECK(tree.Shard_Count() > 1);
+        vector<int> visited;
+        tree.Visit_In_Order([&visited](const int& x){
+            visited.push_back(x);
+        });
+        CHECK(visited == vector<int>(model.begin(), model.end()));
+    }
+
+    const int threads = 4;
+    const int steps = 40000;
+    ShardedTree<int> tree(64, 512, 32);
+    vector<multiset<int> > models(threads);
+    atomic<long> wrong(0);
+    atomic<int> writing(threads);
+    Run_Threads(threads + 1, [&](int t){
+        if(t == threads){
+            while(writing > 0){
+                if(!tree.Verify() || tree.Size() < 0)
+                    wrong++;
+            }
+            return;
+        }
+        mt19937 mine(seed + t);
+        multiset<int>& model = models[t];
+        for(int step = 0; step < steps; step++){
+            int x = (int)(mine() % (1 << 14)) * threads + t;
+            unsigned what = mine() % 10;
+            bool ok = true;
+            if(what < 5){
+                tree.Red_Black_Insert(x);
+                model.insert(x);
+            }
+            else if(what < 8)
+                ok = tree.Red_Black_Delete(x) == Erase_One(model, x);
+            else
+                ok = tree.Find(x) == (model.count(x) > 0);
+            if(!ok)
+                wrong++;
+        }
+        writing--;
+    });
+    CHECK(wrong == 0);
+    multiset<int> all;
+    for(int t = 0; t < threads; t++)
+        all.insert(models[t].begin(), models[t].end());
+    CHECK(tree.Verify() && tree.Size() == (long)all.size() && Same_Contents(tree, all));
+    CHECK(tree.Shard_Count() > 1);
+}
+
+// copy-on-write handles: a handful of them, each with its own model, copied
+// into one another at random.  A copy must share the tree; a write through
+// a shared handle must clone it and leave every other handle as it was,
+// except a delete of something that isn't there, which mustn't clone at all
+static void Test_Cow(unsigned seed){
+    mt19937 rng(seed);
+    const int handles = 6;
+    const int ranges[] = { 16, 500, 1 << 20 };
+    for(int r = 0; r < 3; r++){
+        vector<CowRedBlackTree<int> > trees(handles);
+        vector<multiset<int> > models(handles);
+        for(int step = 0; step < 20000; step++){
+            int h = (int)(rng() % handles);
+            CowRedBlackTree<int>& tree = trees[h];
+            multiset<int>& model = models[h];
+            int x = (int)(rng() % ranges[r]);
+            unsigned what = rng() % 40;
+            bool ok = true;
+            if(what < 16){
+                const RedBlackTree<int>* before = &tree.Read();
+                bool shared = tree.Is_Shared();
+                if(what < 4)
+                    tree.Red_Black_Insert_Hinted(x);
+                else
+                    tree.Red_Black_Insert(x);
+                model.insert(x);
+                ok = !tree.Is_Shared() && (&tree.Read() != before) == shared;
+            }
+            else if(what < 28){
+                bool shared = tree.Is_Shared();
+                bool had = Erase_One(model, x);
+                ok = tree.Red_Black_Delete(x) == had && tree.Is_Shared() == (shared && !had);
+            }
+            else if(what < 38)
+                ok = tree.Find(x) == (model.count(x) > 0);
+            else{
+                int from = (int)(rng() % handles);
+                tree = trees[from];
+                model = models[from];
+                ok = &tree.Read() == &trees[from].Read() && (from == h || tree.Is_Shared());
+            }
+            if(!CHECK(ok))
+                return;
+            if(Verify_Now(step, tree.Read().Size()) && !(CHECK(tree.Read().Verify()) && CHECK(Same_Contents(tree, model))))
+                return;
+        }
+        for(int h = 0; h < handles; h++)
+            CHECK(trees[h].Read().Verify() && Same_Contents(trees[h], models[h]));
+
+        // Write on a shared handle clones, and the clone is a deep copy
+        CowRedBlackTree<int> copy = trees[0];
+        RedBlackTree<int>& mine = copy.Write();
+        CHECK(!copy.Is_Shared() && &mine != &trees[0].Read());
+        mine.Red_Black_Insert(-1);
+        CHECK(Same_Contents(trees[0], models[0]));
+    }
+}
+
+// SmallRedBlackTree around its two thresholds: the size drifts up past N
+// and back down below N / 2 again and again, and the form has to change at
+// exactly those points, promoting on the insert that makes N + 1 and
+// demoting on the delete that leaves N / 2 - 1, never anywhere in between.
+// Copies are taken in either form
+static void Test_Small(unsigned seed){
+    mt19937 rng(seed);
+    const int N = 8;
+    const int ranges[] = { 4, 12, 1000 };
+    for(int r = 0; r < 3; r++){
+        SmallRedBlackTree<int, N> tree;
+        multiset<int> model;
+        bool promoted = false;
+        int promotions = 0;
+        bool growing = true;
+        for(int step = 0; step < 20000; step++){
+            if(model.size() > 2 * N)
+                growing = false;
+            else if(model.size() < N / 4)
+                growing = true;
+            int x = (int)(rng() % ranges[r]);
+            if(!model.empty() && rng() % 2 == 0) // a hit, or big ranges would never shrink
+                x = *next(model.begin(), rng() % model.size());
+            unsigned what = rng() % 10;
+            bool ok = true;
+            if(what < (growing ? 6u : 3u)){
+                tree.Red_Black_Insert(x);
+                model.insert(x);
+                if(!promoted && model.size() == N + 1){
+                    promoted = true;
+                    promotions++;
+                }
+            }
+            else if(what < 9){
+                ok = tree.Red_Black_Delete(x) == Erase_One(model, x);
+                if(promoted && model.size() < N / 2)
+                    promoted = false;
+            }
+            else
+                ok = tree.Find(x) == (model.count(x) > 0);
+            if(!CHECK(ok) || !CHECK(tree.Size() == (long)model.size()) || !CHECK(tree.Is_Promoted() == promoted))
+                return;
+            if(!CHECK(tree.Verify()) || !CHECK(Same_Contents(tree, model)))
+                return;
+            if(rng() % 64 == 0){
+                SmallRedBlackTree<int, N> copy(tree);
+                SmallRedBlackTree<int, N> assigned;
+                assigned.Red_Black_Insert(-1);
+                assigned = tree;
+                if(!CHECK(copy.Is_Promoted() == promoted && copy.Verify() && Same_Contents(copy, model))
+                   || !CHECK(assigned.Is_Promoted() == promoted && assigned.Verify() && Same_Contents(assigned, model)))
+                    return;
+                copy.Red_Black_Insert(-1);
+                CHECK(Same_Contents(tree, model));
+            }
+        }
+        CHECK(promotions > 10);
+    }
+}
+
+// whether Find_Many agrees with the model on batches of every size from
+// empty to several times the group it interleaves, with repeats and misses
+template <typename Container>
+static bool Same_Finds(const Container& tree, const multiset<int>& model, int range, mt19937& rng){
+    int sizes[] = { 0, 1, 2, 7, 8, 9, 31, 100, 1000 };
+    for(int s = 0; s < 9; s++){
+        vector<int> keys;
+        for(int i = 0; i < sizes[s]; i++)
+            keys.push_back(i % 5 == 4 && i > 0 ? keys[rng() % i] : (int)(rng() % range));
+        vector<bool> found(3, true); // stale answers that must be overwritten
+        tree.Find_Many(keys, found);
+        if(!CHECK(found.size() == keys.size()))
+            return false;
+        for(size_t i = 0; i < keys.size(); i++){
+            if(!CHECK(found[i] == (model.count(keys[i]) > 0)))
+                return false;
+        }
+    }
+    return true;
+}
+
+// Find_Many on trees in every state that changes what a lookup has to step
+// over: tombstones, a relaxed backlog, a filter and a Compact arena, and on
+// a treap
+static void Test_Find_Many(unsigned seed){
+    mt19937 rng(seed);
+    const int ranges[] = { 16, 2000, 1 << 20 };
+    for(int r = 0; r < 3; r++){
+        for(int mode = 0; mode < 5; mode++){
+            RedBlackTree<int> tree;
+            multiset<int> model;
+            if(mode == 1)
+                tree.Set_Lazy_Delete(true, 0.5);
+            else if(mode == 2)
+                tree.Set_Relaxed(true);
+            else if(mode == 3)
+                tree.Set_Filter(true);
+            for(int round = 0; round < 8; round++){
+                if(!Random_Red_Black(tree, model, ranges[r], 1500, rng))
+                    return;
+                if(mode == 4)
+                    tree.Compact();
+                if(!Same_Finds(tree, model, ranges[r], rng))
+                    return;
+            }
+        }
+        Tree<int> treap;
+        multiset<int> model;
+        treap.Set_Randomized(true);
+        if(!Random_Tree(treap, model, ranges[r], 5000, rng) || !Same_Finds(treap, model, ranges[r], rng))
+            return;
+    }
+}
+
+// a path-like key: a few segments from a small alphabet, so keys share long
+// beginnings, repeat, and are often prefixes of one another
+static string Path_Key(mt19937& rng, int spread){
+    static const char* segments[] = { "/usr", "/lib", "/local", "/share", "/x", "" };
+    string key;
+    int parts = (int)(rng() % 6);
+    for(int i = 0; i < parts; i++)
+        key += segments[rng() % (spread < 6 ? spread : 6)];
+    if(rng() % 4 == 0)
+        key += to_string(rng() % (unsigned)(spread * spread));
+    return key;
+}
+
+// inserts ("inserts" in 20 of the steps), deletes, half of them of a key
+// that's there, and finds on path-like keys.  Returns false at the first
+// answer that's wrong, and sets "repacked" if the arena ever shrank
+static bool Random_Strings(StringRedBlackTree& tree, multiset<string>& model, int spread, unsigned inserts, int steps, mt19937& rng, bool& repacked){
+    size_t arenaBefore = tree.Arena_Bytes();
+    for(int step = 0; step < steps; step++){
+        string x = Path_Key(rng, spread);
+        if(rng() % 3 == 0) // long enough for the dead bytes to matter
+            x += string(60, (char)('a' + rng() % 3));
+        unsigned what = rng() % 20;
+        bool ok = true;
+        if(what < inserts){
+            tree.Red_Black_Insert(x);
+            model.insert(x);
+        }
+        else if(what < 17){
+            if(!model.empty() && rng() % 2 == 0)
+                x = *next(model.begin(), rng() % model.size());
+            ok = tree.Red_Black_Delete(x) == Erase_One(model, x);
+        }
+        else
+            ok = tree.Find(x) == (model.count(x) > 0);
+        if(tree.Arena_Bytes() < arenaBefore)
+            repacked = true;
+        arenaBefore = tree.Arena_Bytes();
+        if(!CHECK(ok) || !CHECK(tree.Size() == (long)model.size()))
+            return false;
+        if(Verify_Now(step, tree.Size()) && !CHECK(tree.Verify()))
+            return false;
+    }
+    return CHECK(tree.Verify()) && CHECK(Same_Contents(tree, model));
+}
+
+// StringRedBlackTree with and without interning, on path-like keys: a
+// growing phase, copies, and a shrinking one that has to repack the arena.
+// A copy packs its keys, so it has to store exactly the bytes of the ones
+// that aren't a prefix of the next, and interning has to store less than
+// the keys add up to
+static void Test_Strings(unsigned seed){
+    mt19937 rng(seed);
+    const int spreads[] = { 2, 6, 400 };
+    for(int r = 0; r < 3; r++){
+        for(int interning = 0; interning < 2; interning++){
+            StringRedBlackTree tree;
+            tree.Set_Interning(interning == 1);
+            multiset<string> model;
+            bool repacked = false;
+            if(!Random_Strings(tree, model, spreads[r], 12, 10000, rng, repacked))
+                return;
+
+            // what a packed copy should store: every key but those that are
+            // a prefix of the next one up
+            size_t logical = 0;
+            size_t packed = 0;
+            for(multiset<string>::iterator it = model.begin(); it != model.end(); ++it){
+                multiset<string>::iterator after = next(it);
+                logical += it->size();
+                if(after == model.end() || after->compare(0, it->size(), *it) != 0)
+                    packed += it->size();
+            }
+            StringRedBlackTree copy(tree);
+            StringRedBlackTree assigned;
+            assigned.Red_Black_Insert("stale");
+            assigned = tree;
+            CHECK(copy.Verify() && Same_Contents(copy, model));
+            CHECK(assigned.Verify() && Same_Contents(assigned, model));
+            CHECK(copy.Key_Bytes() == packed && assigned.Key_Bytes() == packed);
+            if(interning == 1)
+                CHECK(tree.Key_Bytes() < logical);
+            copy.Red_Black_Insert("/usr");
+            CHECK(Same_Contents(tree, model));
+
+            if(!Random_Strings(tree, model, spreads[r], 2, 10000, rng, repacked))
+                return;
+            if(interning == 0) // interned keys may never leave enough dead bytes
+                CHECK(repacked);
+        }
+    }
+}
+
+// IndexedRedBlackTree against the model, with Verify checking the stored
+// heights along with the rest.  Freed slots have to be reused: churn that
+// keeps the size where it is mustn't grow the vectors.  Copies are plain vector copies and must be just as sound
+static void Test_Indexed(unsigned seed){
+    mt19937 rng(seed);
+    const int ranges[] = { 8, 200, 1 << 20 };
+    for(int r = 0; r < 3; r++){
+        IndexedRedBlackTree<int> tree;
+        multiset<int> model;
+        for(int step = 0; step < 20000; step++){
+            int x = (int)(rng() % ranges[r]);
+            unsigned what = rng() % 20;
+            bool ok = true;
+            if(what < 9){
+                tree.Red_Black_Insert(x);
+                model.insert(x);
+            }
+            else if(what < 16)
+                ok = tree.Red_Black_Delete(x) == Erase_One(model, x);
+            else
+                ok = tree.Find(x) == (model.count(x) > 0);
+            if(!CHECK(ok) || !CHECK(tree.Size() == (long)model.size()))
+                return;
+            if(Verify_Now(step, tree.Size()) && !CHECK(tree.Verify()))
+                return;
+        }
+        CHECK(tree.Verify() && Same_Contents(tree, model));
+        CHECK(tree.Height() <= 2 * Min_Height(tree.Size()));
+
+        IndexedRedBlackTree<int> copy(tree);
+        IndexedRedBlackTree<int> assigned;
+        assigned.Red_Black_Insert(-1);
+        assigned = tree;
+        CHECK(copy.Verify() && Same_Contents(copy, model));
+        CHECK(assigned.Verify() && Same_Contents(assigned, model));
+        copy.Red_Black_Insert(-1);
+        CHECK(Same_Contents(tree, model));
+
+        size_t bytes = tree.Bytes();
+        for(int step = 0; step < 20000; step++){ // more than the vectors could have spare
+            int x = (int)(rng() % ranges[r]);
+            tree.Red_Black_Insert(x);
+            model.insert(x);
+            int y = *next(model.begin(), rng() % model.size());
+            if(!CHECK(tree.Red_Black_Delete(y) && Erase_One(model, y)))
+                return;
+        }
+        CHECK(tree.Bytes() == bytes);
+        CHECK(tree.Verify() && Same_Contents(tree, model));
+
+        vector<int> items(model.begin(), model.end());
+        shuffle(items.begin(), items.end(), rng);
+        for(size_t i = 0; i < items.size(); i++){
+            if(!CHECK(tree.Red_Black_Delete(items[i])))
+                return;
+            if(Verify_Now((int)i, tree.Size()) && !CHECK(tree.Verify()))
+                return;
+        }
+        CHECK(tree.Verify() && tree.Size() == 0 && tree.Height() == 0);
+    }
+}
+
+// plays a trace back into a fresh tree and model, checking that every find
+// and delete hits exactly when it did while recording.  Returns the replay's
+// contents through "model"
+static bool Replay_Trace(const vector<TraceRecord<int> >& records, multiset<int>& model){
+    RedBlackTree<int> tree;
+    uint64_t ns = 0;
+    for(size_t i = 0; i < records.size(); i++){
+        const TraceRecord<int>& r = records[i];
+        int x = r.key;
+        if(!CHECK(r.ns >= ns))
+            return false;
+        ns = r.ns;
+        bool ok = true;
+        if(r.Op() == TRACE_RESET){
+            tree = RedBlackTree<int>();
+            model.clear();
+        }
+        else if(r.Op() == TRACE_INSERT){
+            tree.Red_Black_Insert(x);
+            model.insert(x);
+            ok = r.Hit();
+        }
+        else if(r.Op() == TRACE_DELETE)
+            ok = !r.Preload() && tree.Red_Black_Delete(x) == r.Hit() && Erase_One(model, x) == r.Hit();
+        else
+            ok = !r.Preload() && tree.Find(x) == r.Hit();
+        if(!CHECK(ok))
+            return false;
+    }
+    return CHECK(tree.Verify()) && CHECK(Same_Contents(tree, model));
+}
+
+// record a random run, starting on a tree that already has items in it and
+// with every kind of call that records: hinted inserts, Find_Many, pops,
+// Expire_Before, Compact and Build_From_Sorted.  Reading the trace back has
+// to give one record per operation and replay to the same answers and the
+// same contents.  Then a trace with a delta of 2^63 ns, the longest varint
+// there is, has to read back, and one with a varint longer still mustn't
+static void Test_Trace(unsigned seed){
+    mt19937 rng(seed);
+    const char* path = "rbtree_tests.trace";
+    const int ranges[] = { 16, 2000, 1 << 20 };
+    for(int r = 0; r < 3; r++){
+        RedBlackTree<int> tree;
+        multiset<int> model;
+        if(!Random_Red_Black(tree, model, ranges[r], 500, rng))
+            return;
+        TraceRecorder<int> recorder;
+        if(!CHECK(recorder.Open(path)) || !CHECK(tree.Set_Recorder(&recorder)))
+            return;
+        uint64_t expected = model.size();
+        for(int step = 0; step < 10000; step++){
+            int x = (int)(rng() % ranges[r]);
+            unsigned what = rng() % 100;
+            bool ok = true;
+            if(what < 40){
+                if(what < 10)
+                    tree.Red_Black_Insert_Hinted(x);
+                else
+                    tree.Red_Black_Insert(x);
+                model.insert(x);
+                expected++;
+            }
+            else if(what < 65){
+                ok = tree.Red_Black_Delete(x) == Erase_One(model, x);
+                expected++;
+            }
+            else if(what < 80){
+                ok = tree.Find(x) == (model.count(x) > 0);
+                expected++;
+            }
+            else if(what < 90){
+                vector<int> keys(1 + rng() % 20, x);
+                for(size_t i = 1; i < keys.size(); i++)
+                    keys[i] = (int)(rng() % ranges[r]);
+                vector<bool> found;
+                tree.Find_Many(keys, found);
+                expected += keys.size();
+            }
+            else if(what < 96){
+                int got = 0;
+                ok = tree.Pop_Min(got) == !model.empty();
+                if(!model.empty()){
+                    Erase_One(model, got);
+                    expected++;
+                }
+            }
+            else if(what < 98){
+                long dropped = (long)distance(model.begin(), model.lower_bound(x / 8));
+                model.erase(model.begin(), model.lower_bound(x / 8));
+                ok = tree.Expire_Before(x / 8) == dropped;
+                expected += dropped;
+            }
+            else if(what < 99){
+                tree.Compact();
+                expected += 1 + model.size();
+            }
+            else{
+                vector<int> items(model.begin(), model.end());
+                tree.Build_From_Sorted(items);
+                expected += 1 + model.size();
+            }
+            if(!CHECK(ok))
+                return;
+        }
+        CHECK(tree.Set_Recorder(NULL));
+        tree.Red_Black_Insert(-1); // not recorded any more
+        recorder.Close();
+        if(!CHECK(recorder.Count() == expected))
+            return;
+
+        TraceReader reader;
+        vector<TraceRecord<int> > records;
+        if(!CHECK(reader.Open(path)) || !CHECK(reader.Key_Kind() == TRACE_SIGNED && reader.Key_Size() == 4)
+           || !CHECK(reader.Read_All(records)) || !CHECK(records.size() == expected))
+            return;
+        multiset<int> replayed;
+        if(!Replay_Trace(records, replayed) || !CHECK(replayed == model))
+            return;
+    }
+
+    // a record is its op byte, the delta's varint and the key
+    for(int extra = 0; extra < 2; extra++){
+        {
+            TraceRecorder<int> recorder;
+            recorder.Open(path);
+        }
+        ofstream out(path, ios::binary | ios::app);
+        char record[] = { TRACE_FIND, '\x80', '\x80', '\x80', '\x80', '\x80', '\x80', '\x80', '\x80', '\x80', '\x01', 7, 0, 0, 0 };
+        string bytes(record, sizeof(record));
+        if(extra == 1)
+            bytes.insert(1, "\x80"); // 11 varint bytes
+        out.write(bytes.data(), bytes.size());
+        out.close();
+        TraceReader reader;
+        vector<TraceRecord<int> > records;
+        CHECK(reader.Open(path));
+        bool read = reader.Read_All(records);
+        if(extra == 0)
+            CHECK(read && records.size() == 1 && records[0].ns == (uint64_t)1 << 63 && records[0].key == 7);
+        else
+            CHECK(!read);
+    }
+    remove(path);
+}
+
+// whether Dump_To_Vector_Parallel, on every thread count, and Dump_To, into
+// a buffer and through an inserter, all give the model's items.  The
+// parallel dump appends, so what's in the vector already has to survive
+template <typename Container>
+static bool Same_Dumps(const Container& tree, const multiset<int>& model){
+    vector<int> expected(model.begin(), model.end());
+    const int threads[] = { 0, 1, 2, 3, 7 };
+    for(int t = 0; t < 5; t++){
+        vector<int> items(2, -7);
+        tree.Dump_To_Vector_Parallel(items, threads[t]);
+        if(!CHECK(items.size() == expected.size() + 2 && items[0] == -7 && items[1] == -7)
+           || !CHECK(equal(expected.begin(), expected.end(), items.begin() + 2)))
+            return false;
+    }
+    vector<int> buffer(expected.size() + 1, -7);
+    if(!CHECK(tree.Dump_To(buffer.begin()) == buffer.end() - 1) || !CHECK(buffer.back() == -7))
+        return false;
+    buffer.pop_back();
+    vector<int> streamed;
+    tree.Dump_To(back_inserter(streamed));
+    return CHECK(buffer == expected) && CHECK(streamed == expected);
+}
+
+// fills "tree" with n items in about 2n random inserts and deletes, so the
+// shape isn't the perfect one Build_From_Sorted would give
+template <typename Container>
+static void Random_Fill(Container& tree, multiset<int>& model, long n, mt19937& rng){
+    while((long)model.size() < n){
+        int x = (int)(rng() % (4 * n + 1));
+        if(rng() % 3 != 0){
+            tree.Insert(x);
+            model.insert(x);
+        }
+        else if(tree.Delete(x) != Erase_One(model, x)){
+            CHECK(false);
+            return;
+        }
+    }
+}
+
+// the exports on trees big enough to be cut into pieces and too small to,
+// with tombstones to skip, a relaxed backlog, and a lopsided unbalanced tree
+// whose pieces are nowhere near the same size
+static void Test_Export(unsigned seed){
+    mt19937 rng(seed);
+    const long sizes[] = { 0, 1, 1000, 100000 };
+    for(int s = 0; s < 4; s++){
+        long n = sizes[s];
+        for(int mode = 0; mode < 3; mode++){
+            RedBlackTree<int> tree;
+            multiset<int> model;
+            if(mode == 1)
+                tree.Set_Lazy_Delete(true, 1.0);
+            else if(mode == 2)
+                tree.Set_Relaxed(true);
+            Random_Fill(tree, model, n, rng);
+            if(!CHECK(tree.Verify()) || !Same_Dumps(tree, model))
+                return;
+        }
+
+        AVLTree<int> avl;
+        multiset<int> model;
+        Random_Fill(avl, model, n, rng);
+        if(!Same_Dumps(avl, model))
+            return;
+
+        UnbalancedTree<int> lopsided;
+        vector<int> items(model.begin(), model.end());
+        lopsided.Build_From_Sorted(items);
+        for(int i = 0; i < 3000 && n > 0; i++){
+            lopsided.Insert(4 * (int)n + i); // a long chain off the right end
+            model.insert(4 * (int)n + i);
+        }
+        if(!CHECK(lopsided.Verify()) || !Same_Dumps(lopsided, model))
+            return;
+    }
+}
+
+// the Bloom filter in front of the tree: random operations with the
+// filter on, which Verify checks holds every live item, through enough
+// deletes that it gets rebuilt again and again; copies and assignment,
+// which must bring their own; turning it off and on with items in the tree;
+// and with lazy deletes, whose revived tombstones it must let through.  On
+// its own the filter must never miss a key it was given and mustn't say
+// "maybe" far more often than its bits per key promise
+static void Test_Filter(unsigned seed){
+    mt19937 rng(seed);
+    const int ranges[] = { 16, 2000, 1 << 20 };
+    for(int r = 0; r < 3; r++){
+        RedBlackTree<int> tree;
+        multiset<int> model;
+        CHECK(tree.Set_Filter(true) && tree.Has_Filter());
+        if(!Random_Red_Black(tree, model, ranges[r], 20000, rng) || !Same_Finds(tree, model, ranges[r], rng))
+            return;
+
+        RedBlackTree<int> copy(tree);
+        RedBlackTree<int> assigned;
+        assigned.Set_Filter(true, 4);
+        for(int i = 0; i < 5000; i++)
+            assigned.Red_Black_Insert(-i);
+        assigned = tree;
+        CHECK(copy.Has_Filter() && assigned.Has_Filter());
+        multiset<int> copyModel = model;
+        if(!Random_Red_Black(copy, copyModel, ranges[r], 2000, rng) || !Random_Red_Black(assigned, model, ranges[r], 2000, rng))
+            return;
+
+        assigned.Set_Filter(false);
+        CHECK(!assigned.Has_Filter());
+        if(!Random_Red_Black(assigned, model, ranges[r], 2000, rng))
+            return;
+        CHECK(assigned.Set_Filter(true, 16));
+        if(!Random_Red_Black(assigned, model, ranges[r], 2000, rng))
+            return;
+
+        assigned.Set_Lazy_Delete(true, 0.5);
+        if(!Random_Red_Black(assigned, model, ranges[r], 5000, rng) || !Same_Finds(assigned, model, ranges[r], rng))
+            return;
+    }
+
+    const int bits[] = { 4, 10, 16 };
+    const double rates[] = { 0.4, 0.02, 0.003 }; // with some margin, eight bits a key set
+    for(int b = 0; b < 3; b++){
+        const int n = 20000;
+        BlockedBloomFilter<int> filter;
+        filter.Reset(n, bits[b]);
+        set<int> added;
+        while((int)added.size() < n){
+            int x = (int)(rng() % (1u << 30));
+            filter.Add(x);
+            added.insert(x);
+        }
+        for(set<int>::iterator it = added.begin(); it != added.end(); ++it){
+            if(!CHECK(filter.May_Contain(*it)))
+                return;
+        }
+        int asked = 0;
+        int maybes = 0;
+        while(asked < 100000){
+            int x = (int)(rng() % (1u << 30));
+            if(added.count(x) > 0)
+                continue;
+            asked++;
+            maybes += filter.May_Contain(x);
+        }
+        CHECK(maybes < rates[b] * asked);
+    }
+}
+
+struct Test{
+    const char* name;
+    void (*run)(unsigned seed);
+};
+
+static const Test tests[] = {
+    {"redblack", Test_Red_Black},
+    {"tree", Test_Tree},
+    {"relaxed", Test_Relaxed},
+    {"lazy", Test_Lazy},
+    {"expire", Test_Expire},
+    {"lockfree", Test_Lock_Free},
+    {"reclaim", Test_Reclaim},
+    {"levelorder", Test_Level_Order},
+    {"policies", Test_Policies},
+    {"splay", Test_Splay},
+    {"sharded", Test_Sharded},
+    {"cow", Test_Cow},
+    {"small", Test_Small},
+    {"findmany", Test_Find_Many},
+    {"strings", Test_Strings},
+    {"indexed", Test_Indexed},
+    {"trace", Test_Trace},
+    {"export", Test_Export},
+    {"filter", Test_Filter},
+};
+
+int main(int argc, char* argv[]){
+    const char* which = argc > 1 ? argv[1] : "all";
+    unsigned seed = argc > 2 ? (unsigned)atoi(argv[2]) : 42;
+
+    bool ran = false;
+    for(size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++){
+        if(strcmp(which, "all") == 0 || strcmp(which, tests[i].name) == 0){
+            long before = failures;
+            tests[i].run(seed);
+            cout << tests[i].name << ": " << (failures == before ? "ok" : "FAILED") << endl;
+            ran = true;
+        }
+    }
+    if(!ran){
+        cerr << "unknown test " << which << ", expected one of: all";
+        for(size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++)
+            cerr << " " << tests[i].name;
+        cerr << endl;
+        return 2;
+    }
+    return failures == 0 ? 0 : 1;
+}
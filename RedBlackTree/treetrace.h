@@ -0,0 +1,263 @@
+//
+//  treetrace.h
+//  RedBlackTree
+//
+//  Operation traces.  A TraceRecorder handed to RedBlackTree::Set_Recorder
+//  writes every insert, delete and find the tree does to a binary file, and
+//  a TraceReader reads one back, for rbtree_replay to run against whichever
+//  container it likes.
+//
+//  The file is a 16 byte header, then one record per operation: an op byte,
+//  the nanoseconds since the record before it as a varint, and the key's
+//  bytes as they sit in memory.  Keys have to be trivially copyable, and a
+//  trace is only good on a machine with the same byte order.
+//
+
+#ifndef TREETRACE_H
+#define TREETRACE_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+using namespace std;
+
+// the low bits of a record's op byte.  A reset empties the tree; the
+// preloads after it are its new contents.  Its key means nothing
+enum TraceOp { TRACE_INSERT = 0, TRACE_DELETE = 1, TRACE_FIND = 2, TRACE_RESET = 3 };
+
+const uint8_t TRACE_OP_MASK = 0x03;
+const uint8_t TRACE_PRELOAD = 0x40; // an item already in the tree when recording started
+const uint8_t TRACE_HIT = 0x80;     // the key was there (finds and deletes), set on every insert
+
+// what kind of key a trace holds, so a reader can tell int from float
+enum TraceKeyKind { TRACE_SIGNED = 'i', TRACE_UNSIGNED = 'u', TRACE_FLOAT = 'f', TRACE_BYTES = 'b' };
+
+// one operation read back from a trace
+template <typename T>
+struct TraceRecord{
+    uint8_t op;  // the TraceOp and flags, as recorded
+    uint64_t ns; // since recording started
+    T key;
+
+    TraceOp Op() const{ return (TraceOp)(op & TRACE_OP_MASK); }
+    bool Hit() const{ return (op & TRACE_HIT) != 0; }
+    bool Preload() const{ return (op & TRACE_PRELOAD) != 0; }
+};
+
+// Writes a trace.  The records are buffered and go to the file in big
+// writes, so recording costs a clock read and a copy per operation.  Like
+// the trees it isn't thread safe; two trees can share one only if they
+// share a lock too
+template <typename T>
+class TraceRecorder{
+public:
+    TraceRecorder();
+    ~TraceRecorder();
+
+    TraceRecorder(const TraceRecorder&) = delete;
+    TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+    // starts a new trace at "path", closing any open one.  False, with the
+    // reason on cerr, if it can't be created
+    bool Open(const char* path);
+
+    bool Is_Open() const;
+
+    // appends one operation.  "flags" is TRACE_HIT, TRACE_PRELOAD, both or
+    // neither
+    void Record(TraceOp op, const T& key, uint8_t flags);
+
+    // writes out what's buffered and closes the file
+    void Close();
+
+    // operations recorded since Open
+    uint64_t Count() const;
+
+private:
+    static const size_t BUFFER = 1 << 16;
+
+    ofstream out;
+    vector<char> buffer;
+    chrono::steady_clock::time_point start;
+    uint64_t last; // ns of the last record
+    uint64_t count;
+
+    void Flush();
+};
+
+// Reads a whole trace into memory, so a replay times the operations and not
+// the file
+class TraceReader{
+public:
+    TraceReader();
+
+    // reads the header.  False, with the reason on cerr, if "path" can't be
+    // read or isn't a trace
+    bool Open(const char* path);
+
+    TraceKeyKind Key_Kind() const;
+
+    int Key_Size() const;
+
+    // reads every record, the keys as T, which must be Key_Size() bytes.
+    // False if the file ends halfway through a record
+    template <typename T>
+    bool Read_All(vector<TraceRecord<T> >& records);
+
+private:
+    ifstream in;
+    TraceKeyKind keyKind;
+    int keySize;
+};
+
+// the header both ends agree on
+const char TRACE_MAGIC[8] = { 'R', 'B', 'T', 'R', 'A', 'C', 'E', '1' };
+const size_t TRACE_HEADER = 16; // magic, key kind, key size, 6 bytes of padding
+
+
+template <typename T>
+TraceRecorder<T>::TraceRecorder(){
+    last = 0;
+    count = 0;
+}
+
+template <typename T>
+TraceRecorder<T>::~TraceRecorder(){
+    Close();
+}
+
+template <typename T>
+bool TraceRecorder<T>::Open(const char* path){
+    static_assert(is_trivially_copyable<T>::value, "traced keys are written as raw bytes");
+    static_assert(sizeof(T) < 256, "the header has one byte for the key size");
+    Close();
+    out.open(path, ios::binary | ios::trunc);
+    if(!out){
+        cerr << path << ": can't create trace" << endl;
+        return false;
+    }
+    char header[TRACE_HEADER] = {};
+    memcpy(header, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    header[8] = (char)(is_floating_point<T>::value ? TRACE_FLOAT
+                       : !is_integral<T>::value ? TRACE_BYTES
+                       : is_signed<T>::value ? TRACE_SIGNED : TRACE_UNSIGNED);
+    header[9] = (char)sizeof(T);
+    out.write(header, TRACE_HEADER);
+    buffer.reserve(BUFFER);
+    start = chrono::steady_clock::now();
+    last = 0;
+    count = 0;
+    return true;
+}
+
+template <typename T>
+bool TraceRecorder<T>::Is_Open() const{
+    return out.is_open();
+}
+
+// Record: the deltas are mostly tens of nanoseconds, one or two varint bytes
+template <typename T>
+void TraceRecorder<T>::Record(TraceOp op, const T& key, uint8_t flags){
+    if(!out.is_open())
+        return;
+    if(buffer.size() + 16 + sizeof(T) > BUFFER)
+        Flush();
+    uint64_t now = (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    uint64_t delta = now - last;
+    last = now;
+    buffer.push_back((char)(op | flags));
+    while(delta >= 0x80){
+        buffer.push_back((char)(delta | 0x80));
+        delta >>= 7;
+    }
+    buffer.push_back((char)delta);
+    const char* bytes = (const char*)&key;
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+    count++;
+}
+
+template <typename T>
+void TraceRecorder<T>::Close(){
+    if(!out.is_open())
+        return;
+    Flush();
+    out.close();
+}
+
+template <typename T>
+uint64_t TraceRecorder<T>::Count() const{
+    return count;
+}
+
+template <typename T>
+void TraceRecorder<T>::Flush(){
+    out.write(buffer.data(), buffer.size());
+    buffer.clear();
+}
+
+inline TraceReader::TraceReader(){
+    keyKind = TRACE_BYTES;
+    keySize = 0;
+}
+
+inline bool TraceReader::Open(const char* path){
+    in.open(path, ios::binary);
+    if(!in){
+        cerr << path << ": can't open trace" << endl;
+        return false;
+    }
+    char header[TRACE_HEADER];
+    if(!in.read(header, TRACE_HEADER) || memcmp(header, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0){
+        cerr << path << ": not a trace" << endl;
+        return false;
+    }
+    keyKind = (TraceKeyKind)header[8];
+    keySize = (unsigned char)header[9];
+    return true;
+}
+
+inline TraceKeyKind TraceReader::Key_Kind() const{
+    return keyKind;
+}
+
+inline int TraceReader::Key_Size() const{
+    return keySize;
+}
+
+// Read_All: reads the rest of the file in one go and decodes it from memory
+template <typename T>
+bool TraceReader::Read_All(vector<TraceRecord<T> >& records){
+    if(keySize != (int)sizeof(T))
+        return false;
+    vector<char> data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    size_t at = 0;
+    uint64_t ns = 0;
+    while(at < data.size()){
+        TraceRecord<T> r;
+        r.op = (uint8_t)data[at++];
+        uint64_t delta = 0;
+        int shift = 0;
+        while(at < data.size() && (data[at] & 0x80) != 0){
+            if(shift >= 64) // longer than any uint64_t, so not a trace
+                return false;
+            delta |= (uint64_t)(data[at++] & 0x7f) << shift;
+            shift += 7;
+        }
+        if(shift >= 64 || at + 1 + sizeof(T) > data.size())
+            return false;
+        delta |= (uint64_t)(unsigned char)data[at++] << shift;
+        ns += delta;
+        r.ns = ns;
+        memcpy((void*)&r.key, data.data() + at, sizeof(T));
+        at += sizeof(T);
+        records.push_back(r);
+    }
+    return true;
+}
+
+#endif